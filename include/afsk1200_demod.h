@@ -8,18 +8,106 @@
 #include "mobilinkd_api.h"
 
 #include <gnuradio/gr_types.h>
-#include <gnuradio/gr_hier_block2.h>
+#include <gnuradio/gr_block.h>
 
 #include <boost/shared_ptr.hpp>
 
+#include <stdint.h>
+
 namespace gr { namespace mobilinkd {
 
-class MOBILINKD_API afsk1200_demod : public virtual gr_hier_block2
+/// The counters an afsk1200_demod keeps from when it is made.
+struct MOBILINKD_API afsk1200_demod_stats
+{
+    uint64_t samples_in;        ///< Input samples taken.
+    uint64_t samples_skipped;   ///< Of those, skipped for want of carrier.
+    uint64_t bits_out;
+    uint64_t work_calls;
+    uint64_t work_ns;           ///< Time spent in general_work() in all.
+    uint64_t max_work_ns;       ///< Time spent in the longest call.
+
+    afsk1200_demod_stats()
+    : samples_in(0), samples_skipped(0), bits_out(0)
+    , work_calls(0), work_ns(0), max_work_ns(0)
+    {}
+};
+
+/**
+ * Demodulates 1200 baud Bell 202 AFSK audio into a stream of bits,
+ * one bit per output byte.
+ *
+ * Audio at @p rate is resampled to @p working_rate before it is
+ * demodulated, so make(rate) no longer gives the bits that earlier
+ * versions did.  A working rate of 0 runs at the input rate, with the
+ * discriminator delay and samples per symbol truncated as before, and
+ * gives the same bits as earlier versions.
+ *
+ * With @p soft, each output byte is a signed soft bit, positive for a
+ * 1, whose magnitude (1 to 127) is the confidence.  With @p packed,
+ * hard bits are output eight to a byte, least significant first.
+ *
+ * With @p fixed_point the block takes short audio and uses integer
+ * arithmetic; it needs the DELAY_LINE type and PLL clock recovery, and
+ * has no carrier detect.  It is bit-exact with the floating point block
+ * with the same settings, given the same 16-bit audio as floats: for
+ * the PLL, which only needs the sign of each sample, that rounds its
+ * input to 16 bits and runs the same integer filters.
+ *
+ * The floating point demodulator tags every 64th bit with
+ * "afsk_quality": a dictionary of the "sample" it came from and the
+ * "timing_error", "level" and "twist" measured since the last tag,
+ * whether or not carrier detect is on.  The "timing_error" is the mean
+ * distance, in symbols (0 to 0.5), of the transitions from halfway
+ * between the sampling points, for either clock recovery.  The "level"
+ * is the RMS of the audio and the "twist" the mark over space tone
+ * power in dB, measured over 5 ms windows; they are left out of a tag
+ * if no window has ended since the last one, as at the very start.
+ */
+class MOBILINKD_API afsk1200_demod : public virtual gr_block
 {
 public:
     typedef boost::shared_ptr<afsk1200_demod> sptr;
 
-    static sptr make(int rate);
+    static const int WORKING_RATE = 24000;
+
+    enum demodulator_type
+    {
+        DELAY_LINE = 0,     ///< Delay and XOR discriminator.
+        CORRELATOR = 1      ///< Sliding mark and space correlators.
+    };
+
+    enum clock_recovery_type
+    {
+        MUELLER_MULLER = 0, ///< Interpolating Mueller & Müller loop.
+        PLL = 1             ///< Fixed-point digital PLL.
+    };
+
+    static sptr make(int rate, int working_rate = WORKING_RATE,
+        bool soft = false, int type = DELAY_LINE,
+        int clock = MUELLER_MULLER, bool fixed_point = false,
+        bool packed = false);
+
+    /**
+     * Set the share of the audio energy that must be at the AFSK tone
+     * frequencies for a carrier to be detected; 0.1 suits most audio.
+     * The default, 0, turns carrier detect off and demodulates
+     * everything.
+     *
+     * No bits are output for skipped audio, so an hdlc_framer's frame
+     * timeout does not run while the channel is quiet.  A frame cut off
+     * by the loss of carrier is ended by the next packet's flags.
+     *
+     * It is safe to call from any thread, such as a GRC callback; the
+     * new threshold takes effect at the next call to general_work().
+     *
+     * @throws std::invalid_argument if @p threshold is above 0 and the
+     *  block was made with fixed_point.
+     */
+    virtual void set_carrier_threshold(float threshold) = 0;
+
+    /// A snapshot of the counters, updated once for each call to
+    /// general_work().  It can be taken from any thread.
+    virtual afsk1200_demod_stats get_stats() const = 0;
 };
 
 }} // gr::mobilinkd
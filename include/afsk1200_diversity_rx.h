@@ -0,0 +1,71 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#ifndef GR__MOBILINKD__AFSK1200_DIVERSITY_RX_H_
+#define GR__MOBILINKD__AFSK1200_DIVERSITY_RX_H_
+
+#include "mobilinkd_api.h"
+#include "log_sink.h"
+#include "hdlc_framer.h"
+
+#include <gnuradio/gr_types.h>
+#include <gnuradio/gr_sync_block.h>
+#include <gnuradio/gr_msg_queue.h>
+
+#include <boost/shared_ptr.hpp>
+
+namespace gr { namespace mobilinkd {
+
+/**
+ * An AFSK1200 receiver that runs several demodulators on the same
+ * audio and merges what they decode.
+ *
+ * Each variant has its own low-pass bandwidth, discriminator delay and
+ * slicer bias, so between them they cope with more de-emphasis and
+ * twist than any one of them can.  Each feeds its own HDLC deframer.
+ * A frame with a good FCS is sent once, by the first variant to decode
+ * it; the same frame from another variant within DEDUPE_BITS bit times
+ * is a duplicate and is dropped.
+ *
+ * The variants are shared out among @p threads worker threads.
+ *
+ * Output is as for hdlc_framer: text on the message queue, PDUs on the
+ * "pdus" port, or both.  The PDU metadata also has "variant", the index
+ * of the variant that decoded the frame.
+ */
+class MOBILINKD_API afsk1200_diversity_rx : public virtual gr_sync_block
+{
+public:
+    typedef boost::shared_ptr<afsk1200_diversity_rx> sptr;
+
+    /// The most variants that can be run.
+    static const int MAX_VARIANTS = 9;
+
+    /// Frames with the same CRC this many bit times apart are duplicates.
+    static const int DEDUPE_BITS = 64;
+
+    static sptr make(int rate, int variants, int threads,
+        gr_msg_queue_sptr msgq = gr_make_msg_queue(),
+        int output = hdlc_framer::TEXT_OUTPUT, int channel = 0);
+
+    virtual gr_msg_queue_sptr msgq() const = 0;
+
+    /// Set where decoded frames are logged, as for hdlc_framer.  By
+    /// default they are not.
+    virtual void set_log_sink(log_sink::sptr sink) = 0;
+
+    /**
+     * The number of frames decoded by each variant, duplicates included.
+     * This and duplicates() are safe to call from any thread.
+     */
+    virtual unsigned long decoded(int variant) const = 0;
+
+    /// The number of duplicate frames dropped.
+    virtual unsigned long duplicates() const = 0;
+
+    virtual ~afsk1200_diversity_rx() {}
+};
+
+}} // gr::mobilinkd
+
+#endif // GR__MOBILINKD__AFSK1200_DIVERSITY_RX_H_
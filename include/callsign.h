@@ -0,0 +1,170 @@
+// Copyright 2012 Robert C. Riggs <rob@pangalactic.org>
+// All rights reserved.
+
+#ifndef GR__MOBILINKD__CALLSIGN_H_
+#define GR__MOBILINKD__CALLSIGN_H_
+
+#include <boost/functional/hash.hpp>
+
+#include <string>
+#include <stdexcept>
+#include <cstddef>
+#include <stdint.h>
+
+namespace gr { namespace mobilinkd {
+
+/**
+ * An AX.25 callsign and SSID packed into a 64-bit integer, so that it
+ * can be compared, hashed and used as a key as cheaply as an integer.
+ *
+ * The six callsign characters occupy bits 51-4, first character in the
+ * most significant byte, padded with spaces.  The SSID is in bits 3-0.
+ * Ordering callsigns by value orders them by callsign, then SSID.
+ */
+class callsign
+{
+public:
+
+    static const size_t LENGTH = 6;
+
+    callsign()
+    : value_(0)
+    {}
+
+    explicit callsign(uint64_t value)
+    : value_(value)
+    {}
+
+    /**
+     * Decode a callsign straight from its 7 byte on-air address field.
+     * As in ax25_frame, the callsign ends at the first space.
+     */
+    static callsign from_field(const uint8_t* field)
+    {
+        uint64_t value = 0;
+        bool end = false;
+
+        for (size_t i = 0; i != LENGTH; ++i)
+        {
+            uint8_t c = field[i] >> 1;
+            end = end or (c == ' ');
+            value = (value << 8) | (end ? ' ' : c);
+        }
+
+        return callsign((value << 4) | ((field[6] >> 1) & 0x0F));
+    }
+
+    /**
+     * Parse a callsign such as "N0CALL-9".
+     *
+     * @throws std::invalid_argument if the callsign is more than six
+     *  characters or the SSID is not a number from 0 to 15.
+     */
+    static callsign from_string(const std::string& text)
+    {
+        std::string::size_type dash = text.find('-');
+        std::string call = text.substr(0, dash);
+
+        if (call.empty() or call.size() > LENGTH
+            or call.find(' ') != std::string::npos)
+        {
+            throw std::invalid_argument("bad callsign: " + text);
+        }
+
+        int ssid = 0;
+        if (dash != std::string::npos)
+        {
+            std::string digits = text.substr(dash + 1);
+            if (digits.empty() or digits.size() > 2)
+            {
+                throw std::invalid_argument("bad callsign: " + text);
+            }
+
+            for (size_t i = 0; i != digits.size(); ++i)
+            {
+                if (digits[i] < '0' or digits[i] > '9')
+                {
+                    throw std::invalid_argument("bad callsign: " + text);
+                }
+                ssid = ssid * 10 + (digits[i] - '0');
+            }
+
+            if (ssid > 15)
+            {
+                throw std::invalid_argument("bad callsign: " + text);
+            }
+        }
+
+        call.resize(LENGTH, ' ');
+
+        uint64_t value = 0;
+        for (size_t i = 0; i != LENGTH; ++i)
+        {
+            value = (value << 8) | uint8_t(call[i]);
+        }
+
+        return callsign((value << 4) | ssid);
+    }
+
+    uint64_t value() const { return value_; }
+
+    int ssid() const { return value_ & 0x0F; }
+
+    /// The callsign without the SSID, trailing spaces removed.
+    std::string call() const
+    {
+        std::string result;
+
+        for (int shift = 44; shift >= 4; shift -= 8)
+        {
+            char c = char((value_ >> shift) & 0xFF);
+            if (c == ' ') break;
+            result += c;
+        }
+
+        return result;
+    }
+
+    /// The callsign as text, in the same form as ax25_frame.
+    std::string str() const
+    {
+        std::string result = call();
+
+        if (ssid())
+        {
+            result += '-';
+            if (ssid() > 9) result += '1';
+            result += char('0' + ssid() % 10);
+        }
+
+        return result;
+    }
+
+    bool operator==(const callsign& other) const
+    {
+        return value_ == other.value_;
+    }
+
+    bool operator!=(const callsign& other) const
+    {
+        return value_ != other.value_;
+    }
+
+    bool operator<(const callsign& other) const
+    {
+        return value_ < other.value_;
+    }
+
+private:
+
+    uint64_t value_;
+};
+
+inline std::size_t hash_value(const callsign& call)
+{
+    return boost::hash<uint64_t>()(call.value());
+}
+
+}} // gr::mobilinkd
+
+#endif // GR__MOBILINKD__CALLSIGN_H_
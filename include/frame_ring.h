@@ -0,0 +1,89 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#ifndef GR__MOBILINKD__FRAME_RING_H_
+#define GR__MOBILINKD__FRAME_RING_H_
+
+#include "mobilinkd_api.h"
+#include "frame_size.h"
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <cstddef>
+
+#include <stdint.h>
+
+namespace gr { namespace mobilinkd {
+
+/// A frame taken from a frame_ring.
+struct MOBILINKD_API ring_frame
+{
+    std::string data;   ///< The raw frame bytes, FCS included.
+    bool crc_ok;        ///< Whether the FCS was valid.
+    uint64_t offset;    ///< The input bit at which the frame was completed.
+
+    ring_frame() : data(), crc_ok(false), offset(0) {}
+};
+
+/**
+ * A bounded ring of frame slots that carries frames from one
+ * hdlc_framer to one consumer, in place of the message queue.  The
+ * slots are allocated when the ring is made, and neither side takes a
+ * lock, so pushing a frame never allocates or blocks the framer --
+ * unless the ring is full and the policy is BLOCK.
+ *
+ * When the ring is full, DROP_OLDEST discards the oldest frame waiting
+ * in it, DROP_NEWEST discards the frame being pushed, and BLOCK makes
+ * the framer wait for the consumer.  Frames discarded are counted by
+ * dropped().  BLOCK waits by sleeping 1 ms at a time inside the
+ * framer's work(), which stalls its flowgraph thread -- and everything
+ * upstream of it -- until the consumer catches up.
+ *
+ * The consumer can poll with pop() or wait() with a timeout.  Reusing
+ * the same ring_frame for each keeps the consumer from allocating, too.
+ */
+class MOBILINKD_API frame_ring
+{
+public:
+    typedef boost::shared_ptr<frame_ring> sptr;
+
+    enum overflow_policy
+    {
+        DROP_OLDEST = 0,
+        DROP_NEWEST = 1,
+        BLOCK = 2
+    };
+
+    /// The largest frame a slot holds; longer frames are truncated.
+    static const size_t MAX_SIZE = MAX_FRAME_SIZE;
+
+    static sptr make(size_t capacity, int policy);
+
+    /**
+     * Add a frame.  This is called by the framer, from its work()
+     * function.  Returns false if the frame was dropped.
+     */
+    virtual bool push(
+        const char* data, size_t size, bool crc_ok, uint64_t offset) = 0;
+
+    /// Take the oldest frame.  Returns false at once if there is none.
+    virtual bool pop(ring_frame& frame) = 0;
+
+    /// Take the oldest frame, waiting up to @p timeout seconds for one.
+    virtual bool wait(ring_frame& frame, double timeout) = 0;
+
+    /// The number of frames waiting.
+    virtual size_t size() const = 0;
+
+    virtual size_t capacity() const = 0;
+
+    /// The number of frames dropped because the ring was full.
+    virtual unsigned long dropped() const = 0;
+
+    virtual ~frame_ring() {}
+};
+
+}} // gr::mobilinkd
+
+#endif // GR__MOBILINKD__FRAME_RING_H_
@@ -0,0 +1,20 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#ifndef GR__MOBILINKD__FRAME_SIZE_H_
+#define GR__MOBILINKD__FRAME_SIZE_H_
+
+#include <cstddef>
+
+namespace gr { namespace mobilinkd {
+
+/**
+ * Room for the largest frame hdlc_framer emits, 331 bytes with its FCS.
+ * Frames are copied into fixed buffers of this size, so that passing
+ * them on never allocates; anything longer is truncated.
+ */
+const size_t MAX_FRAME_SIZE = 332;
+
+}} // gr::mobilinkd
+
+#endif // GR__MOBILINKD__FRAME_SIZE_H_
@@ -5,6 +5,8 @@
 #define GR__MOBILINKD__HDLC_FRAMER_H_
 
 #include "mobilinkd_api.h"
+#include "log_sink.h"
+#include "frame_ring.h"
 
 #include <gnuradio/gr_types.h>
 #include <gnuradio/gr_sync_block.h>
@@ -13,15 +15,69 @@
 
 #include <boost/shared_ptr.hpp>
 
+#include <stdint.h>
+
 namespace gr { namespace mobilinkd {
 
+/// The counters an hdlc_framer keeps from when it is made.
+struct MOBILINKD_API hdlc_framer_stats
+{
+    uint64_t bits_in;           ///< Bits taken from the input.
+    uint64_t flags;             ///< Flags seen.
+    uint64_t frames_attempted;  ///< Frames started after a flag.
+    uint64_t frames_ok;         ///< Frames closed with a valid FCS.
+    uint64_t crc_failures;      ///< Frames closed with a bad FCS.
+    uint64_t too_short;         ///< Frames closed with too few bytes.
+    uint64_t too_long;          ///< Frames dropped for too many bytes.
+    uint64_t stuff_errors;      ///< Frames dropped for six ones in a row.
+    uint64_t timeouts;          ///< Times no frame came before TIMEOUT.
+    uint64_t frames_repaired;   ///< Frames with a bad FCS repaired.
+    uint64_t work_calls;
+    uint64_t work_ns;           ///< Time spent in work() in all.
+    uint64_t max_work_ns;       ///< Time spent in the longest call.
+
+    hdlc_framer_stats()
+    : bits_in(0), flags(0), frames_attempted(0), frames_ok(0)
+    , crc_failures(0), too_short(0), too_long(0), stuff_errors(0)
+    , timeouts(0), frames_repaired(0), work_calls(0), work_ns(0)
+    , max_work_ns(0)
+    {}
+};
+
+/**
+ * Extracts HDLC frames from a stream of bits, one bit per input byte:
+ * hard bits, 0 or 1, or soft bits from afsk1200_demod.
+ *
+ * With soft bits and a @p max_flips of 1 to 3, a frame with a bad FCS
+ * is repaired if flipping that many of its least confident bits makes
+ * the FCS good.  With @p packed, each input byte holds eight hard bits,
+ * least significant first, and @p max_flips must be 0.
+ *
+ * Frames go out as text on @p msgq, as PDUs on the "pdus" port, or
+ * both, as chosen by @p output.  A PDU holds the raw frame and a
+ * dictionary with "crc_ok", "offset" and "start" (input bits), the
+ * @p channel, the "destination" and "source" addresses as callsign
+ * values, and a summary of any "afsk_quality" tags over the frame.
+ * Frames can also be passed to a frame_ring; use an @p output of 0 to
+ * send them to the ring alone.  Only the ring is free of allocation
+ * once decoding is under way: a text message or PDU is built afresh for
+ * each frame.
+ */
 class MOBILINKD_API hdlc_framer : public virtual gr_sync_block
 {
 public:
     typedef boost::shared_ptr<hdlc_framer> sptr;
 
-    static sptr make(bool pass_all);
-    static sptr make(bool pass_all, gr_msg_queue_sptr msgq);
+    enum output_mode
+    {
+        TEXT_OUTPUT = 1,    ///< Formatted text on the message queue.
+        PDU_OUTPUT = 2      ///< Raw frame bytes on the "pdus" port.
+    };
+
+    static sptr make(bool pass_all,
+        gr_msg_queue_sptr msgq = gr_make_msg_queue(),
+        int output = TEXT_OUTPUT, int channel = 0, int max_flips = 0,
+        bool packed = false);
 
     virtual int work(
         int noutput_items,
@@ -30,6 +86,29 @@ public:
 
     virtual gr_msg_queue_sptr msgq() const = 0;
 
+    /**
+     * Set where decoded frames are logged.  By default they are not;
+     * pass log_sink::make_console() to write them to the console, and
+     * an empty pointer to stop.  This may be called while the flowgraph
+     * runs.
+     */
+    virtual void set_log_sink(log_sink::sptr sink) = 0;
+
+    /**
+     * Set a ring to push each frame to, in addition to the @p output
+     * chosen at make().  Pass an empty pointer to stop.  This may be
+     * called while the flowgraph runs.
+     */
+    virtual void set_frame_ring(frame_ring::sptr ring) = 0;
+
+    /// The number of frames with a bad FCS that have been repaired, as
+    /// in get_stats().  It can be called from any thread.
+    virtual uint64_t frames_repaired() const = 0;
+
+    /// A snapshot of the counters, updated once for each call to work().
+    /// It can be taken from any thread.
+    virtual hdlc_framer_stats get_stats() const = 0;
+
     virtual ~hdlc_framer() {}
 
 };
@@ -0,0 +1,48 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#ifndef GR__MOBILINKD__LOG_SINK_H_
+#define GR__MOBILINKD__LOG_SINK_H_
+
+#include "mobilinkd_api.h"
+#include "frame_size.h"
+
+#include <boost/shared_ptr.hpp>
+
+#include <cstddef>
+
+namespace gr { namespace mobilinkd {
+
+/**
+ * Receives a copy of each frame decoded by an hdlc_framer, for logging.
+ *
+ * frame() is called from the framer's work() function, so it must not
+ * block or do I/O.  A sink that writes somewhere should queue the frame
+ * and write it from another thread.
+ */
+class MOBILINKD_API log_sink
+{
+public:
+    typedef boost::shared_ptr<log_sink> sptr;
+
+    /// A sink that discards everything.
+    static sptr make_null();
+
+    /**
+     * The process-wide console sink.  Frames are queued on a bounded
+     * lock-free queue and written to std::cout by a background thread.
+     * Frames are dropped if the queue is full.
+     */
+    static sptr make_console();
+
+    virtual void frame(const char* data, size_t size, bool crc_ok) = 0;
+
+    /// The number of frames dropped because the sink could not keep up.
+    virtual unsigned long dropped() const { return 0; }
+
+    virtual ~log_sink() {}
+};
+
+}} // gr::mobilinkd
+
+#endif // GR__MOBILINKD__LOG_SINK_H_
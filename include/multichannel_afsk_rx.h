@@ -0,0 +1,62 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#ifndef GR__MOBILINKD__MULTICHANNEL_AFSK_RX_H_
+#define GR__MOBILINKD__MULTICHANNEL_AFSK_RX_H_
+
+#include "mobilinkd_api.h"
+#include "log_sink.h"
+#include "hdlc_framer.h"
+
+#include <gnuradio/gr_types.h>
+#include <gnuradio/gr_sync_block.h>
+#include <gnuradio/gr_msg_queue.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+
+namespace gr { namespace mobilinkd {
+
+/**
+ * Decodes AFSK1200 packet radio on many FM channels at once from one
+ * complex baseband capture.
+ *
+ * The capture is split into @p nchannels equally spaced channels by a
+ * critically sampled polyphase filter bank and an FFT.  Channel k is
+ * centred on k * rate / nchannels Hz from the centre of the capture;
+ * channels below the centre are given as negative numbers.  Each
+ * channel listed in @p channels is FM demodulated and decoded by its
+ * own AFSK1200 demodulator and HDLC deframer, at rate / nchannels
+ * samples/second rounded down to a multiple of 1200.
+ *
+ * Output is as for hdlc_framer: text on the message queue, PDUs on the
+ * "pdus" port, or both.  The "channel" of each PDU is the channel
+ * number, as given in @p channels, that it was decoded from.  Only
+ * frames with a good FCS are sent.
+ *
+ * @throws std::invalid_argument if @p rate is not a multiple of
+ *  @p nchannels or a channel number is out of range.
+ */
+class MOBILINKD_API multichannel_afsk_rx : public virtual gr_sync_block
+{
+public:
+    typedef boost::shared_ptr<multichannel_afsk_rx> sptr;
+
+    static sptr make(int rate, int nchannels,
+        const std::vector<int>& channels,
+        gr_msg_queue_sptr msgq = gr_make_msg_queue(),
+        int output = hdlc_framer::TEXT_OUTPUT);
+
+    virtual gr_msg_queue_sptr msgq() const = 0;
+
+    /// Set where decoded frames are logged, as for hdlc_framer.  By
+    /// default they are not.
+    virtual void set_log_sink(log_sink::sptr sink) = 0;
+
+    virtual ~multichannel_afsk_rx() {}
+};
+
+}} // gr::mobilinkd
+
+#endif // GR__MOBILINKD__MULTICHANNEL_AFSK_RX_H_
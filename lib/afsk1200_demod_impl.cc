@@ -4,94 +4,953 @@
 #include "afsk1200_demod_impl.h"
 
 #include <gnuradio/gr_io_signature.h>
-#include <gnuradio/gr_sync_block.h>
-
-#include <gnuradio/digital_binary_slicer_fb.h>
-#include <gnuradio/gr_delay.h>
-#include <gnuradio/gr_xor_bb.h>
-#include <gnuradio/gr_char_to_float.h>
+#include <gnuradio/gr_math.h>
 #include <gnuradio/filter/firdes.h>
-#include <gnuradio/filter/fir_filter_fff.h>
-#include <gnuradio/gr_dc_blocker_ff.h>
-#include <gnuradio/digital_clock_recovery_mm_ff.h>
-#include <gnuradio/digital_diff_decoder_bb.h>
+
+#include <boost/math/common_factor_rt.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cassert>
 
 namespace gr { namespace mobilinkd {
 
-afsk1200_demod::sptr afsk1200_demod::make(int rate)
+afsk1200_demod::sptr afsk1200_demod::make(int rate, int working_rate,
+    bool soft, int type, int clock, bool fixed_point, bool packed)
 {
-    return afsk1200_demod_impl::make(rate);
+    return afsk1200_demod_impl::make(
+        rate, working_rate, soft, type, clock, fixed_point, packed);
 }
 
 
 namespace detail {
 
-struct invert_bit : public virtual gr_sync_block
+const float carrier_detector::DEFAULT_THRESHOLD = 0.1F;
+
+// A clean symbol is about 0.5 from the threshold.
+const float afsk1200_demodulator::SOFT_SCALE = 254.0F;
+
+namespace {
+
+/**
+ * The discriminator delay and the nominal samples per symbol at @p rate.
+ * With no working rate both are truncated, as they always were, so that
+ * the bits are the same as the original block's.
+ */
+size_t delay_samples(double delay, int rate, int working_rate)
+{
+    return working_rate ? size_t(delay * rate + 0.5)
+        : size_t(delay / (1.0 / rate));
+}
+
+float nominal_omega(int rate, int working_rate)
+{
+    return working_rate ? rate / 1200.0F : float(rate / 1200);
+}
+
+} // namespace
+
+carrier_detector::carrier_detector(int rate, float threshold)
+: window_(std::max(1, rate * WINDOW_MS / 1000)), count_(0)
+, energy_(0), threshold_(threshold), carrier_(false)
+, window_energy_(0)
+{
+    coeff_[0] = 2.0 * std::cos(2.0 * M_PI * 1200.0 / rate);
+    coeff_[1] = 2.0 * std::cos(2.0 * M_PI * 2200.0 / rate);
+    s1_[0] = s1_[1] = s2_[0] = s2_[1] = 0;
+    tone_power_[0] = tone_power_[1] = 0;
+}
+
+bool carrier_detector::operator()(const float* input, int n)
+{
+    assert(n <= remaining());
+
+    for (int i = 0; i != n; ++i)
+    {
+        const float x = input[i];
+        for (int t = 0; t != 2; ++t)
+        {
+            const float s = x + coeff_[t] * s1_[t] - s2_[t];
+            s2_[t] = s1_[t];
+            s1_[t] = s;
+        }
+        energy_ += x * x;
+    }
+
+    count_ += n;
+    if (count_ != window_) return false;
+
+    // A tone of amplitude A gives a Goertzel power of (A N / 2)^2 and
+    // an energy of A^2 N / 2, so the power is scaled by 2 / (N E).
+    for (int t = 0; t != 2; ++t)
+    {
+        tone_power_[t] = s1_[t] * s1_[t] + s2_[t] * s2_[t]
+            - coeff_[t] * s1_[t] * s2_[t];
+        s1_[t] = s2_[t] = 0;
+    }
+
+    const float power = tone_power_[0] + tone_power_[1];
+    carrier_ = energy_ > 0 and 2 * power > threshold_ * window_ * energy_;
+
+    window_energy_ = energy_;
+    count_ = 0;
+    energy_ = 0;
+
+    return true;
+}
+
+quality_report quality_meter::report(uint64_t bit, uint64_t sample)
+{
+    // The windows that ended by the sample the bit was taken at.
+    double energy = 0;
+    uint64_t samples = 0;
+    double mark = 0;
+    double space = 0;
+
+    size_t n = 0;
+    for (; n != windows_.size() and windows_[n].end <= sample; ++n)
+    {
+        energy += windows_[n].energy;
+        samples += windows_[n].samples;
+        mark += windows_[n].mark;
+        space += windows_[n].space;
+    }
+    windows_.erase(windows_.begin(), windows_.begin() + n);
+
+    quality_report result;
+    result.bit = bit;
+    result.sample = sample;
+    result.tones = samples != 0;
+    result.level = result.tones ? float(std::sqrt(energy / samples)) : 0;
+    result.twist = mark > 0 and space > 0
+        ? float(10 * std::log10(mark / space)) : 0;
+    result.timing_error = timings_ ? float(timing_ / timings_) : 0;
+
+    clear();
+    return result;
+}
+
+tone_correlator::tone_correlator(int rate, int frequency, int length)
+: tone_(rate / boost::math::gcd(rate, frequency))
+, phase_(0)
+, products_(length, gr_complex(0))
+, pos_(0)
+, sum_(0)
+{
+    for (size_t n = 0; n != tone_.size(); ++n)
+    {
+        const double phase = -2.0 * M_PI * frequency * double(n) / rate;
+        tone_[n] = gr_complex(std::cos(phase), std::sin(phase));
+    }
+}
+
+rational_resampler::rational_resampler(
+    int interpolation, int decimation, const std::vector<float>& taps)
+: interpolation_(interpolation), decimation_(decimation)
+, ntaps_((taps.size() + interpolation - 1) / interpolation)
+, taps_(ntaps_ * interpolation, 0.0)
+, buffer_(ntaps_ - 1, 0.0)
+, phase_(0), skip_(0)
+{
+    // Branch p holds taps p, p + L, p + 2L, ... in reverse order.
+    for (size_t i = 0; i != taps.size(); ++i)
+    {
+        const size_t branch = i % interpolation;
+        const size_t k = i / interpolation;
+        taps_[branch * ntaps_ + ntaps_ - 1 - k] = taps[i];
+    }
+}
+
+int rational_resampler::input_required(int noutput) const
+{
+    return int((int64_t(noutput) * decimation_ + interpolation_ - 1)
+        / interpolation_) + skip_;
+}
+
+void rational_resampler::operator()(
+    const float* input, size_t n, std::vector<float>& output)
 {
-    typedef boost::shared_ptr<invert_bit> sptr;
+    const size_t history = ntaps_ - 1;
+
+    buffer_.insert(buffer_.end(), input, input + n);
 
-    static sptr make()
+    // Input sample i is buffer_[i + history], the newest sample under
+    // the filter when the output is computed at buffer_[i].
+    size_t i = skip_;
+    while (i < n)
     {
-        return sptr(new invert_bit);
+        const float* taps = &taps_[phase_ * ntaps_];
+        const float* samples = &buffer_[i];
+
+        float sum = 0;
+        for (size_t k = 0; k != ntaps_; ++k)
+        {
+            sum += taps[k] * samples[k];
+        }
+        output.push_back(sum);
+
+        phase_ += decimation_;
+        i += phase_ / interpolation_;
+        phase_ %= interpolation_;
     }
 
-    invert_bit()
-    : gr_sync_block("invert_bit",
-        gr_make_io_signature(1, 1, 1),
-        gr_make_io_signature(1, 1, 1))
-    {}
+    skip_ = i - n;
+
+    // Carry the history over to the next call.
+    std::copy(buffer_.end() - history, buffer_.end(), buffer_.begin());
+    buffer_.resize(history);
+}
+
+fixed_resampler::fixed_resampler(const rational_resampler& resampler)
+: interpolation_(resampler.interpolation_)
+, decimation_(resampler.decimation_)
+, ntaps_(resampler.ntaps_)
+, taps_(resampler.taps_.size())
+, buffer_(ntaps_ - 1, 0)
+, phase_(0), skip_(0)
+{
+    // Scale the taps so that the branch with the most gain sums to at
+    // most 1.0 in Q15.  No output can then exceed 2^30.
+    float gain = 0;
+    for (int p = 0; p != interpolation_; ++p)
+    {
+        float sum = 0;
+        for (size_t k = 0; k != ntaps_; ++k)
+        {
+            sum += std::fabs(resampler.taps_[p * ntaps_ + k]);
+        }
+        gain = std::max(gain, sum);
+    }
 
-    int work(
-        int size,
-        gr_vector_const_void_star& input_items,
-        gr_vector_void_star& output_items)
+    for (size_t i = 0; i != taps_.size(); ++i)
     {
-        const unsigned char* source =
-            reinterpret_cast<const unsigned char*>(input_items[0]);
-        unsigned char* dest =
-            reinterpret_cast<unsigned char*>(output_items[0]);
+        taps_[i] = int16_t(
+            std::floor(resampler.taps_[i] * 32767.0F / gain + 0.5F));
+    }
+}
+
+int fixed_resampler::input_required(int noutput) const
+{
+    return int((int64_t(noutput) * decimation_ + interpolation_ - 1)
+        / interpolation_) + skip_;
+}
 
-        for (int i = 0; i != size; ++i)
+void fixed_resampler::operator()(
+    const int16_t* input, size_t n, std::vector<int32_t>& output)
+{
+    const size_t history = ntaps_ - 1;
+
+    buffer_.insert(buffer_.end(), input, input + n);
+
+    size_t i = skip_;
+    while (i < n)
+    {
+        const int16_t* taps = &taps_[phase_ * ntaps_];
+        const int16_t* samples = &buffer_[i];
+
+        int32_t sum = 0;
+        for (size_t k = 0; k != ntaps_; ++k)
         {
-            dest[i] = source[i] ? 0 : 1;
+            sum += int32_t(taps[k]) * samples[k];
         }
+        output.push_back(sum);
+
+        phase_ += decimation_;
+        i += phase_ / interpolation_;
+        phase_ %= interpolation_;
+    }
 
-        return size;
+    skip_ = i - n;
+
+    std::copy(buffer_.end() - history, buffer_.end(), buffer_.begin());
+    buffer_.resize(history);
+}
+
+fixed_discriminator::fixed_discriminator(
+    int rate, double cutoff, size_t delay)
+: delay_(delay), sliced_(delay_ + BLOCK_SIZE, 0)
+, taps_(), filter_input_()
+, dc_blocker_(DC_BLOCKER_LENGTH)
+{
+    // Reversed, as fir_filter_fff keeps them, so that the output is the
+    // same dot product over the input.
+    const std::vector<float> taps =
+        gr::filter::firdes::low_pass(1, rate, cutoff, 300);
+    for (size_t i = taps.size(); i != 0; --i)
+    {
+        taps_.push_back(int16_t(std::floor(taps[i - 1] * 32768 + 0.5F)));
     }
-};
+
+    filter_input_.resize(taps_.size() - 1 + BLOCK_SIZE, 0);
+}
+
+template <typename T>
+void fixed_discriminator::operator()(
+    const T* input, size_t n, std::vector<int32_t>& output)
+{
+    assert(n <= BLOCK_SIZE);
+
+    const size_t ntaps = taps_.size();
+    const size_t history = ntaps - 1;
+    unsigned char* sliced = &sliced_[delay_];
+    int16_t* discriminated = &filter_input_[history];
+
+    for (size_t i = 0; i != n; ++i)
+    {
+        sliced[i] = (input[i] >= 0);
+    }
+
+    for (size_t i = 0; i != n; ++i)
+    {
+        discriminated[i] = int16_t(sliced[i] ^ sliced_[i]);
+    }
+
+    // The low-pass filter, in Q15.  The taps of a unity gain filter and
+    // an input of 0 or 1 cannot overflow 32 bits.
+    const int16_t* taps = &taps_[0];
+    for (size_t i = 0; i != n; ++i)
+    {
+        const int16_t* samples = &filter_input_[i];
+
+        int32_t sum = 0;
+        for (size_t k = 0; k != ntaps; ++k)
+        {
+            sum += int32_t(taps[k]) * samples[k];
+        }
+        output.push_back(dc_blocker_(sum));
+    }
+
+    std::copy(sliced_.begin() + n, sliced_.begin() + n + delay_,
+        sliced_.begin());
+    std::copy(filter_input_.begin() + n, filter_input_.begin() + n + history,
+        filter_input_.begin());
+}
+
+rational_resampler afsk1200_demodulator::make_resampler(
+    int rate, int working_rate)
+{
+    if (rate == working_rate)
+    {
+        return rational_resampler(1, 1, std::vector<float>(1, 1.0));
+    }
+
+    const int divisor = boost::math::gcd(rate, working_rate);
+    const int interpolation = working_rate / divisor;
+    const int decimation = rate / divisor;
+
+    // Pass 80% of the lower of the two bands and stop at its edge.
+    const double band = std::min(rate, working_rate);
+    return rational_resampler(interpolation, decimation,
+        gr::filter::firdes::low_pass(interpolation,
+            double(rate) * interpolation, 0.4 * band, 0.2 * band));
+}
+
+afsk1200_demodulator::afsk1200_demodulator(int rate, double cutoff,
+    double delay, float bias, int working_rate, int type, int clock)
+: rate_(working_rate ? working_rate : rate), bias_(bias), soft_(false)
+, packed_(false), packer_()
+, type_(type), clock_(clock)
+, resample_(rate_ != rate)
+, resampler_(make_resampler(rate, rate_))
+, resampled_()
+, delay_(delay_samples(delay, rate_, working_rate))
+, sliced_(delay_ + BLOCK_SIZE, 0)
+, filter_(1, gr::filter::firdes::low_pass(1, rate_, cutoff, 300))
+, filter_input_(filter_.ntaps() - 1 + BLOCK_SIZE, 0.0)
+, filter_output_(BLOCK_SIZE)
+, dc_blocker_(DC_BLOCKER_LENGTH)
+, fixed_point_(type == afsk1200_demod::DELAY_LINE
+    and clock == afsk1200_demod::PLL)
+, fixed_resampler_(resampler_)
+, discriminator_(rate_, cutoff, delay_)
+, rounded_(), fixed_resampled_(), discriminated_()
+, mark_(rate_, 1200, int(rate_ / 1200.0 + 0.5))
+, space_(rate_, 2200, int(rate_ / 1200.0 + 0.5))
+, interp_(), filtered_(), index_(0)
+, mu_(.240), omega_(nominal_omega(rate_, working_rate))
+, omega_mid_(omega_)
+, omega_lim_(omega_mid_ * .00005F)
+, gain_mu_(.01), gain_omega_(.00005)
+, last_sample_(0)
+, pll_(omega_mid_)
+, detector_(rate, 0), carrier_detect_(false), active_(true), hang_(0)
+, preroll_(PREROLL_WINDOWS * detector_.window_, 0.0)
+, preroll_pos_(0), preroll_size_(0)
+, received_(0), skipped_(0)
+, reporting_(false), meter_(), reports_(), symbols_(0), base_(0)
+, fed_input_(0), fed_working_(0)
+{
+    if (delay_ == 0)
+    {
+        throw std::invalid_argument("afsk1200_demod: sample rate too low");
+    }
+}
+
+int afsk1200_demodulator::input_required(int noutput) const
+{
+    int required = int(std::ceil(noutput * bits_per_output() * omega_))
+        + interp_.ntaps();
+    return resample_ ? resampler_.input_required(required) : required;
+}
+
+void afsk1200_demodulator::front_end(const float* input, size_t n)
+{
+    assert(n <= BLOCK_SIZE);
+
+    const size_t history = filter_.ntaps() - 1;
+    unsigned char* sliced = &sliced_[delay_];
+    float* discriminated = &filter_input_[history];
+
+    // Binary slicer.
+    for (size_t i = 0; i != n; ++i)
+    {
+        sliced[i] = (input[i] >= 0);
+    }
+
+    // Delay and XOR.
+    for (size_t i = 0; i != n; ++i)
+    {
+        discriminated[i] = float(sliced[i] ^ sliced_[i]);
+    }
+
+    filter_.filterN(&filter_output_[0], &filter_input_[0], n);
+
+    for (size_t i = 0; i != n; ++i)
+    {
+        filtered_.push_back(dc_blocker_(filter_output_[i]));
+    }
+
+    // Carry the history over to the next block.
+    std::copy(sliced_.begin() + n, sliced_.begin() + n + delay_,
+        sliced_.begin());
+    std::copy(filter_input_.begin() + n, filter_input_.begin() + n + history,
+        filter_input_.begin());
+}
+
+void afsk1200_demodulator::set_carrier_threshold(float threshold)
+{
+    detector_.threshold_ = threshold;
+
+    // A new threshold alone leaves the gate as it is.
+    const bool detect = threshold > 0;
+    if (detect == carrier_detect_) return;
+
+    carrier_detect_ = detect;
+    active_ = not detect;
+    hang_ = 0;
+    preroll_pos_ = 0;
+    preroll_size_ = 0;
+}
+
+int afsk1200_demodulator::input_wanted(int noutput) const
+{
+    // Only as much input as the clock recovery needs to fill the output.
+    int wanted = int(std::ceil(noutput * bits_per_output() * omega_))
+        + interp_.ntaps()
+        + int(index_) - int(filtered_.size());
+    if (resample_ and wanted > 0) wanted = resampler_.input_required(wanted);
+    return wanted;
+}
+
+void afsk1200_demodulator::feed(const float* input, size_t n, uint64_t first)
+{
+    const float* samples = input;
+    size_t nsamples = n;
+
+    fed_input_ = first;
+    fed_working_ = base_ + filtered_.size();
+
+    if (fixed_point_)
+    {
+        feed_fixed(input, n);
+        return;
+    }
+
+    if (resample_)
+    {
+        resampled_.clear();
+        resampler_(input, n, resampled_);
+        samples = resampled_.empty() ? 0 : &resampled_[0];
+        nsamples = resampled_.size();
+    }
+
+    if (type_ == afsk1200_demod::CORRELATOR)
+    {
+        correlate(samples, nsamples);
+        return;
+    }
+
+    for (size_t i = 0; i < nsamples; i += BLOCK_SIZE)
+    {
+        front_end(samples + i, std::min(nsamples - i, BLOCK_SIZE));
+    }
+}
+
+void afsk1200_demodulator::feed_fixed(const float* input, size_t n)
+{
+    if (not resample_)
+    {
+        for (size_t i = 0; i < n; i += BLOCK_SIZE)
+        {
+            fixed_front_end(input + i, std::min(n - i, BLOCK_SIZE));
+        }
+        return;
+    }
+
+    // Rounded to 16 bits, which loses nothing from a sound card, for
+    // the same resampler as fixed_point_demodulator.
+    rounded_.resize(n);
+    for (size_t i = 0; i != n; ++i)
+    {
+        const float x = std::floor(input[i] * 32768 + 0.5F);
+        rounded_[i] = int16_t(std::max(-32768.0F, std::min(32767.0F, x)));
+    }
+
+    fixed_resampled_.clear();
+    fixed_resampler_(
+        rounded_.empty() ? 0 : &rounded_[0], n, fixed_resampled_);
+
+    const size_t nsamples = fixed_resampled_.size();
+    for (size_t i = 0; i < nsamples; i += BLOCK_SIZE)
+    {
+        fixed_front_end(&fixed_resampled_[i],
+            std::min(nsamples - i, BLOCK_SIZE));
+    }
+}
+
+template <typename T>
+void afsk1200_demodulator::fixed_front_end(const T* input, size_t n)
+{
+    discriminated_.clear();
+    discriminator_(input, n, discriminated_);
+
+    // Q15 to float is exact, so the PLL sees the same signs.
+    for (size_t i = 0; i != n; ++i)
+    {
+        filtered_.push_back(discriminated_[i] / 32768.0F);
+    }
+}
+
+void afsk1200_demodulator::correlate(const float* input, size_t n)
+{
+    // Scaled to the +/-0.5 of the delay line discriminator, which the
+    // clock recovery gains and the soft bits are set for.  Mark, 1200 Hz,
+    // is positive, as it is for the discriminator.
+    for (size_t i = 0; i != n; ++i)
+    {
+        const float mark = mark_(input[i]);
+        const float space = space_(input[i]);
+        const float total = mark + space;
+        filtered_.push_back(total > 0 ? 0.5F * (mark - space) / total : 0);
+    }
+}
+
+void afsk1200_demodulator::measure(
+    const float* input, int n, uint64_t first)
+{
+    // With carrier detect off the detector is only run for the level
+    // and twist of each window.
+    while (n != 0)
+    {
+        const int m = std::min(n, detector_.remaining());
+        first += m;
+        if (detector_(input, m)) meter_.add_window(detector_, first);
+        input += m;
+        n -= m;
+    }
+}
+
+void afsk1200_demodulator::update_carrier(uint64_t end)
+{
+    if (detector_.carrier())
+    {
+        if (not active_)
+        {
+            active_ = true;
+            feed_preroll(end);
+        }
+        hang_ = HANG_WINDOWS;
+    }
+    else if (active_ and --hang_ <= 0)
+    {
+        active_ = false;
+    }
+}
+
+void afsk1200_demodulator::save_preroll(const float* input, size_t n)
+{
+    const size_t capacity = preroll_.size();
+
+    for (size_t i = 0; i != n; ++i)
+    {
+        preroll_[preroll_pos_] = input[i];
+        if (++preroll_pos_ == capacity) preroll_pos_ = 0;
+    }
+
+    preroll_size_ = std::min(preroll_size_ + n, capacity);
+}
+
+void afsk1200_demodulator::feed_preroll(uint64_t end)
+{
+    // The pre-roll holds the input just before @p end.
+    const size_t capacity = preroll_.size();
+    const size_t start = (preroll_pos_ + capacity - preroll_size_) % capacity;
+    const size_t first = std::min(preroll_size_, capacity - start);
+
+    feed(&preroll_[start], first, end - preroll_size_);
+    feed(&preroll_[0], preroll_size_ - first, end - preroll_size_ + first);
+
+    preroll_size_ = 0;
+}
+
+int afsk1200_demodulator::operator()(
+    const float* input, int ninput,
+    unsigned char* output, int noutput,
+    int& consumed)
+{
+    if (not carrier_detect_)
+    {
+        consumed = std::max(0, std::min(ninput, input_wanted(noutput)));
+        feed(input, consumed, received_);
+        if (reporting_) measure(input, consumed, received_);
+        received_ += consumed;
+        return recover(output, noutput);
+    }
+
+    // The input is taken a detector window at a time, so that the
+    // carrier can be turned on and off at each window boundary.
+    consumed = 0;
+    int produced = 0;
+
+    while (consumed < ninput and produced < noutput)
+    {
+        const float* samples = input + consumed;
+        int n = std::min(ninput - consumed, detector_.remaining());
+
+        if (active_)
+        {
+            n = std::min(n, std::max(1, input_wanted(noutput - produced)));
+            feed(samples, n, received_ + consumed);
+        }
+        else
+        {
+            save_preroll(samples, n);
+            skipped_ += n;
+        }
+
+        consumed += n;
+
+        // Windows in which nothing is demodulated are not measured,
+        // except the one that opens the gate.
+        if (detector_(samples, n))
+        {
+            update_carrier(received_ + consumed);
+            if (reporting_ and active_)
+            {
+                meter_.add_window(detector_, received_ + consumed);
+            }
+        }
+
+        produced += recover(output + produced, noutput - produced);
+    }
+
+    received_ += consumed;
+    return produced;
+}
+
+int afsk1200_demodulator::output_symbol(unsigned char* output, float symbol)
+{
+    if (soft_)
+    {
+        *output = soft_bit(bias_ - symbol);
+        return 1;
+    }
+
+    const int bit = gr_binary_slicer(symbol - bias_) ? 0 : 1;
+    if (not packed_)
+    {
+        *output = bit;
+        return 1;
+    }
+
+    return packer_(bit, *output);
+}
+
+int afsk1200_demodulator::recover(unsigned char* output, int noutput)
+{
+    const int ntaps = interp_.ntaps();
+
+    int produced = 0;
+
+    // The PLL needs no look ahead.  It only has work to do at a zero
+    // crossing or a sampling point, so it scans the samples between
+    // them for the next crossing.
+    while (clock_ == afsk1200_demod::PLL and produced < noutput
+        and index_ < filtered_.size())
+    {
+        const size_t wanted = pll_.until_sample();
+        const size_t end = std::min(filtered_.size(), index_ + wanted);
+
+        size_t i = index_;
+        while (i != end and (filtered_[i] >= bias_) == pll_.high_) ++i;
+
+        const bool crossed = i != end;
+        if (crossed) ++i;
+
+        pll_.advance(i - index_);
+        const bool sample = i - index_ == wanted;
+        index_ = i;
+
+        if (crossed)
+        {
+            const int32_t error = pll_.transition();
+            if (reporting_) meter_.add_timing(error / 4294967296.0F);
+        }
+        if (not sample) continue;
+
+        produced += output_symbol(output + produced, filtered_[i - 1]);
+        if (reporting_) count_symbol(i - 1);
+    }
+
+    // Mueller & Müller clock recovery, as done by clock_recovery_mm_ff,
+    // followed by the slicer and the bit inverter.
+    while (clock_ == afsk1200_demod::MUELLER_MULLER and produced < noutput
+        and index_ + ntaps <= filtered_.size())
+    {
+        float sample = interp_.interpolate(&filtered_[index_], mu_);
+        const float previous = last_sample_;
+        float mm_val = slice(last_sample_) * sample
+            - slice(sample) * last_sample_;
+        last_sample_ = sample;
+
+        omega_ = omega_ + gain_omega_ * mm_val;
+        omega_ = omega_mid_
+            + gr_branchless_clip(omega_ - omega_mid_, omega_lim_);
+        mu_ = mu_ + omega_ + gain_mu_ * mm_val;
+
+        if (reporting_)
+        {
+            // mm_val is scaled by the signal level, so the error is
+            // measured as the PLL measures it: how far, in symbols, a
+            // transition is from halfway between the samples either
+            // side of it, found by linear interpolation.
+            if (slice(sample) != slice(previous))
+            {
+                meter_.add_timing(previous / (previous - sample) - 0.5F);
+            }
+            count_symbol(index_);
+        }
+
+        index_ += (int) std::floor(mu_);
+        mu_ = mu_ - std::floor(mu_);
+
+        produced += output_symbol(output + produced, sample);
+    }
+
+    // The clock recovery may step past the end of the filtered samples.
+    // Those samples are skipped as they arrive.
+    if (index_ >= filtered_.size())
+    {
+        index_ -= filtered_.size();
+        base_ += filtered_.size();
+        filtered_.clear();
+    }
+    else
+    {
+        filtered_.erase(filtered_.begin(), filtered_.begin() + index_);
+        base_ += index_;
+        index_ = 0;
+    }
+
+    return produced;
+}
+
+void afsk1200_demodulator::report(size_t position)
+{
+    // Working samples are mapped back to the input at the input rate,
+    // less the delay through the filters: the low-pass filter and the
+    // DC blocker, or the correlators, which are all linear phase.
+    const double ratio =
+        double(resampler_.decimation_) / resampler_.interpolation_;
+    const int64_t delay = type_ == afsk1200_demod::CORRELATOR
+        ? int64_t(mark_.products_.size() / 2)
+        : int64_t(2 * (DC_BLOCKER_LENGTH - 1) + (filter_.ntaps() - 1) / 2);
+    const int64_t offset =
+        int64_t(base_ + position) - delay - int64_t(fed_working_);
+    const int64_t sample = int64_t(fed_input_)
+        + int64_t(std::floor(offset * ratio + 0.5));
+
+    reports_.push_back(
+        meter_.report(symbols_ - 1, uint64_t(std::max<int64_t>(sample, 0))));
+}
+
+fixed_point_demodulator::fixed_point_demodulator(int rate,
+    double cutoff, double delay, float bias, int working_rate)
+: rate_(working_rate ? working_rate : rate)
+, bias_(int32_t(std::floor(bias * Q15 + 0.5F))), soft_(false)
+, packed_(false), packer_()
+, resample_(rate_ != rate)
+, resampler_(afsk1200_demodulator::make_resampler(rate, rate_))
+, resampled_()
+, discriminator_(rate_, cutoff, delay_samples(delay, rate_, working_rate))
+, filtered_(), index_(0)
+, omega_(nominal_omega(rate_, working_rate))
+, pll_(omega_)
+, received_(0)
+{
+    if (discriminator_.delay_ == 0)
+    {
+        throw std::invalid_argument("afsk1200_demod: sample rate too low");
+    }
+}
+
+int fixed_point_demodulator::input_required(int noutput) const
+{
+    int required = int(std::ceil(noutput * bits_per_output() * omega_));
+    return resample_ ? resampler_.input_required(required) : required;
+}
+
+int fixed_point_demodulator::input_wanted(int noutput) const
+{
+    // The PLL has no look ahead.
+    int wanted = int(std::ceil(noutput * bits_per_output() * omega_))
+        + int(index_) - int(filtered_.size());
+    if (resample_ and wanted > 0) wanted = resampler_.input_required(wanted);
+    return wanted;
+}
+
+void fixed_point_demodulator::feed(const int16_t* input, size_t n)
+{
+    if (not resample_)
+    {
+        for (size_t i = 0; i < n; i += BLOCK_SIZE)
+        {
+            discriminator_(input + i, std::min(n - i, BLOCK_SIZE), filtered_);
+        }
+        return;
+    }
+
+    resampled_.clear();
+    resampler_(input, n, resampled_);
+
+    for (size_t i = 0; i < resampled_.size(); i += BLOCK_SIZE)
+    {
+        discriminator_(&resampled_[i],
+            std::min(resampled_.size() - i, BLOCK_SIZE), filtered_);
+    }
+}
+
+int fixed_point_demodulator::output_symbol(
+    unsigned char* output, int32_t symbol)
+{
+    if (soft_)
+    {
+        *output = soft_bit(bias_ - symbol);
+        return 1;
+    }
+
+    const int bit = symbol >= bias_ ? 0 : 1;
+    if (not packed_)
+    {
+        *output = bit;
+        return 1;
+    }
+
+    return packer_(bit, *output);
+}
+
+int fixed_point_demodulator::recover(unsigned char* output, int noutput)
+{
+    // As for the PLL in afsk1200_demodulator::recover().
+    int produced = 0;
+    while (produced < noutput and index_ < filtered_.size())
+    {
+        const size_t wanted = pll_.until_sample();
+        const size_t end = std::min(filtered_.size(), index_ + wanted);
+
+        size_t i = index_;
+        while (i != end and (filtered_[i] >= bias_) == pll_.high_) ++i;
+
+        const bool crossed = i != end;
+        if (crossed) ++i;
+
+        pll_.advance(i - index_);
+        const bool sample = i - index_ == wanted;
+        index_ = i;
+
+        if (crossed) pll_.transition();
+        if (not sample) continue;
+
+        produced += output_symbol(output + produced, filtered_[i - 1]);
+    }
+
+    filtered_.erase(filtered_.begin(), filtered_.begin() + index_);
+    index_ = 0;
+
+    return produced;
+}
+
+int fixed_point_demodulator::operator()(
+    const int16_t* input, int ninput,
+    unsigned char* output, int noutput,
+    int& consumed)
+{
+    consumed = std::max(0, std::min(ninput, input_wanted(noutput)));
+    feed(input, consumed);
+    received_ += consumed;
+    return recover(output, noutput);
+}
 
 } // detail
 
-afsk1200_demod_impl::afsk1200_demod_impl(int rate)
-: gr_hier_block2("afsk1200_demod",
-    gr_make_io_signature(1, 1, sizeof(float)),
+
+const float afsk1200_demod_impl::NO_THRESHOLD = -1.0F;
+
+afsk1200_demod_impl::afsk1200_demod_impl(int rate, int working_rate,
+    bool soft, int type, int clock, bool fixed_point, bool packed)
+: gr_block("afsk1200_demod",
+    gr_make_io_signature(1, 1, fixed_point ? sizeof(short) : sizeof(float)),
     gr_make_io_signature(1, 1, sizeof(char)))
 , rate_(rate)
+, demod_()
+, fixed_()
+, quality_key_(pmt::pmt_intern("afsk_quality"))
+, sample_key_(pmt::pmt_intern("sample"))
+, level_key_(pmt::pmt_intern("level"))
+, timing_error_key_(pmt::pmt_intern("timing_error"))
+, twist_key_(pmt::pmt_intern("twist"))
+, stats_(), skipped_(0), threshold_(NO_THRESHOLD)
 {
-    digital_binary_slicer_fb_sptr slicer_1 = digital_make_binary_slicer_fb();
-    gr_delay_sptr delay = gr_make_delay(1, int(.000448 / (1.0 / rate)));
-    gr_xor_bb_sptr gr_xor = gr_make_xor_bb();
-    gr_char_to_float_sptr char_to_float = gr_make_char_to_float();
-    gr::filter::fir_filter_fff::sptr filter = gr::filter::fir_filter_fff::make(
-        1, gr::filter::firdes::low_pass(1, rate_, 1200, 300));
-    gr_dc_blocker_ff_sptr dc_blocker = gr_make_dc_blocker_ff(1024, true);
-    digital_clock_recovery_mm_ff_sptr clock_recovery =
-        digital_make_clock_recovery_mm_ff(rate / 1200, .00005, .240, .01, .00005);
-    digital_binary_slicer_fb_sptr slicer_2 = digital_make_binary_slicer_fb();
-    detail::invert_bit::sptr inverter = detail::invert_bit::make();
-
-
-    connect(self(), 0, slicer_1, 0);
-    connect(slicer_1, 0, delay, 0);
-    connect(slicer_1, 0, gr_xor, 0);
-    connect(delay, 0, gr_xor, 1);
-    connect(gr_xor, 0, char_to_float, 0);
-    connect(char_to_float, 0, filter, 0);
-    connect(filter, 0, dc_blocker, 0);
-    connect(dc_blocker, 0, clock_recovery, 0);
-    connect(clock_recovery, 0, slicer_2, 0);
-    connect(slicer_2, 0, inverter, 0);
-    connect(inverter, 0, self(), 0);
+    if (soft and packed)
+    {
+        throw std::invalid_argument(
+            "afsk1200_demod: soft bits cannot be packed");
+    }
+
+    if (fixed_point)
+    {
+        if (type != DELAY_LINE or clock != PLL)
+        {
+            throw std::invalid_argument(
+                "afsk1200_demod: fixed point needs DELAY_LINE and PLL");
+        }
+
+        fixed_.reset(new detail::fixed_point_demodulator(
+            rate, 1200, .000448, 0, working_rate));
+        fixed_->set_soft_output(soft);
+        fixed_->set_packed_output(packed);
+        set_relative_rate(1200.0 / rate / fixed_->bits_per_output());
+    }
+    else
+    {
+        demod_.reset(new detail::afsk1200_demodulator(
+            rate, 1200, .000448, 0, working_rate, type, clock));
+        demod_->set_soft_output(soft);
+        demod_->set_packed_output(packed);
+        demod_->set_reporting(true);
+        set_relative_rate(1200.0 / rate / demod_->bits_per_output());
+    }
 }
 
 
@@ -99,4 +958,126 @@ afsk1200_demod_impl::~afsk1200_demod_impl()
 {}
 
 
+void afsk1200_demod_impl::forecast(
+    int noutput_items, gr_vector_int& ninput_items_required)
+{
+    const int required = fixed_ ? fixed_->input_required(noutput_items)
+        : demod_->input_required(noutput_items);
+
+    for (size_t i = 0; i != ninput_items_required.size(); ++i)
+    {
+        ninput_items_required[i] = required;
+    }
+}
+
+
+int afsk1200_demod_impl::general_work(
+    int noutput_items,
+    gr_vector_int& ninput_items,
+    gr_vector_const_void_star& input_items,
+    gr_vector_void_star& output_items)
+{
+    const gruel::high_res_timer_type start = gruel::high_res_timer_now();
+    unsigned char* dest = reinterpret_cast<unsigned char*>(output_items[0]);
+
+    int consumed = 0;
+    int produced = 0;
+
+    if (fixed_)
+    {
+        const int16_t* source =
+            reinterpret_cast<const int16_t*>(input_items[0]);
+        produced = (*fixed_)(
+            source, ninput_items[0], dest, noutput_items, consumed);
+    }
+    else
+    {
+        const float threshold = threshold_.exchange(NO_THRESHOLD);
+        if (threshold != NO_THRESHOLD) demod_->set_carrier_threshold(threshold);
+
+        const float* source = reinterpret_cast<const float*>(input_items[0]);
+        produced = (*demod_)(
+            source, ninput_items[0], dest, noutput_items, consumed);
+        publish_reports();
+    }
+
+    consume_each(consumed);
+
+    const int bits = fixed_ ? fixed_->bits_per_output()
+        : demod_->bits_per_output();
+    stats_.add(SAMPLES_IN, consumed);
+    stats_.add(BITS_OUT, uint64_t(produced) * bits);
+    if (demod_)
+    {
+        stats_.add(SAMPLES_SKIPPED, demod_->skipped() - skipped_);
+        skipped_ = demod_->skipped();
+    }
+
+    const uint64_t ns = detail::ns_since(start);
+    stats_.add(WORK_CALLS, 1);
+    stats_.add(WORK_NS, ns);
+    stats_.raise(MAX_WORK_NS, ns);
+
+    return produced;
+}
+
+void afsk1200_demod_impl::set_carrier_threshold(float threshold)
+{
+    if (fixed_)
+    {
+        if (threshold > 0)
+        {
+            throw std::invalid_argument(
+                "afsk1200_demod: fixed point has no carrier detect");
+        }
+        return;
+    }
+
+    // Called from the GUI or Python thread; general_work() applies it.
+    threshold_.store(std::max(0.0F, threshold));
+}
+
+afsk1200_demod_stats afsk1200_demod_impl::get_stats() const
+{
+    afsk1200_demod_stats result;
+    result.samples_in = stats_.get(SAMPLES_IN);
+    result.samples_skipped = stats_.get(SAMPLES_SKIPPED);
+    result.bits_out = stats_.get(BITS_OUT);
+    result.work_calls = stats_.get(WORK_CALLS);
+    result.work_ns = stats_.get(WORK_NS);
+    result.max_work_ns = stats_.get(MAX_WORK_NS);
+    return result;
+}
+
+void afsk1200_demod_impl::publish_reports()
+{
+    // Reports are made every REPORT_INTERVAL bits, a multiple of eight,
+    // so a packed report is on the first bit of an output byte.
+    const int bits = demod_->bits_per_output();
+
+    for (size_t i = 0; i != demod_->reports_.size(); ++i)
+    {
+        const detail::quality_report& report = demod_->reports_[i];
+
+        pmt::pmt_t value = pmt::pmt_make_dict();
+        value = pmt::pmt_dict_add(value, sample_key_,
+            pmt::pmt_from_uint64(report.sample));
+        value = pmt::pmt_dict_add(value, timing_error_key_,
+            pmt::pmt_from_double(report.timing_error));
+
+        if (report.tones)
+        {
+            value = pmt::pmt_dict_add(value, level_key_,
+                pmt::pmt_from_double(report.level));
+            value = pmt::pmt_dict_add(value, twist_key_,
+                pmt::pmt_from_double(report.twist));
+        }
+
+        add_item_tag(0, report.bit / bits, quality_key_, value);
+    }
+
+    demod_->reports_.clear();
+}
+
+
 }} // gr::mobilinkd
@@ -5,26 +5,824 @@
 #define GR__MOBILINKD__AFSK1200_DEMOD_IMPL_H_
 
 #include "afsk1200_demod.h"
+#include "block_stats.h"
+
+#include <boost/atomic.hpp>
+
+#include <gnuradio/gr_complex.h>
+#include <gnuradio/filter/fir_filter.h>
+#include <gnuradio/gri_mmse_fir_interpolator_ff.h>
+#include <gruel/pmt.h>
+
+#include <complex>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
 
 namespace gr { namespace mobilinkd {
 
+namespace detail {
+
+/**
+ * A moving average filter of length D.  This is the moving_averager_f
+ * from gr_dc_blocker_ff, with the delay line kept in a ring buffer
+ * rather than a deque.  The arithmetic is kept in the same order so
+ * that the results are identical.
+ *
+ * With an integer T the running sum is exact, so it does not drift,
+ * and the average is rounded towards zero.
+ */
+template <typename T>
+struct moving_average
+{
+    std::vector<T> delay_line_;
+    size_t pos_;
+    int length_;
+    T out_;
+    T out_d1_;
+    T out_d2_;
+
+    moving_average(int length)
+    : delay_line_(length - 1, 0.0), pos_(0), length_(length)
+    , out_(0), out_d1_(0), out_d2_(0)
+    {}
+
+    T operator()(T x)
+    {
+        out_d1_ = out_;
+        out_ = delay_line_[pos_];
+        delay_line_[pos_] = x;
+        if (++pos_ == delay_line_.size()) pos_ = 0;
+
+        T y = x - out_d1_ + out_d2_;
+        out_d2_ = y;
+
+        return (y / (T)(length_));
+    }
+
+    T delayed_sig() const { return out_; }
+};
+
+/**
+ * The long form of gr_dc_blocker_ff: four cascaded moving averages
+ * subtracted from the delayed input signal.
+ */
+template <typename T>
+struct dc_blocker
+{
+    moving_average<T> ma_0_;
+    moving_average<T> ma_1_;
+    moving_average<T> ma_2_;
+    moving_average<T> ma_3_;
+    std::vector<T> delay_line_;
+    size_t pos_;
+
+    dc_blocker(int length)
+    : ma_0_(length), ma_1_(length), ma_2_(length), ma_3_(length)
+    , delay_line_(length - 1, 0.0), pos_(0)
+    {}
+
+    T operator()(T x)
+    {
+        T y1 = ma_0_(x);
+        T y2 = ma_1_(y1);
+        T y3 = ma_2_(y2);
+        T y4 = ma_3_(y3);
+
+        T d = delay_line_[pos_];
+        delay_line_[pos_] = ma_0_.delayed_sig();
+        if (++pos_ == delay_line_.size()) pos_ = 0;
+
+        return d - y4;
+    }
+};
+
+/**
+ * A polyphase rational resampler, which changes the sample rate by
+ * interpolation / decimation.  This is the algorithm used by
+ * rational_resampler_base_fff: the low-pass filter, designed at the
+ * interpolated rate, is split into interpolation branches and only the
+ * branch that lands on each output sample is evaluated.  No zeros are
+ * stuffed and no discarded samples are computed.
+ *
+ * Each branch is stored reversed, so that an output sample is a plain
+ * dot product over the input history.
+ */
+struct rational_resampler
+{
+    int interpolation_;
+    int decimation_;
+    size_t ntaps_;              ///< Taps per branch.
+    std::vector<float> taps_;   ///< Branch p is taps_[p * ntaps_ ...].
+    std::vector<float> buffer_; ///< ntaps_ - 1 samples of history + input.
+    int phase_;                 ///< The branch for the next output.
+    size_t skip_;               ///< Input samples to skip before it.
+
+    rational_resampler(int interpolation, int decimation,
+        const std::vector<float>& taps);
+
+    /// The number of input samples needed to produce @p noutput samples.
+    int input_required(int noutput) const;
+
+    /// Resample @p n samples from @p input, appending them to @p output.
+    void operator()(const float* input, size_t n, std::vector<float>& output);
+};
+
+/**
+ * A rational_resampler for 16-bit input, with Q15 taps.  Its output
+ * only goes to the slicer of the delay line discriminator, so only the
+ * sign matters: the taps are scaled so that no branch can overflow 32
+ * bits, and the output is left at that scale.
+ */
+struct fixed_resampler
+{
+    int interpolation_;
+    int decimation_;
+    size_t ntaps_;
+    std::vector<int16_t> taps_;
+    std::vector<int16_t> buffer_;
+    int phase_;
+    size_t skip_;
+
+    /// The same resampler as @p resampler, in fixed point.
+    explicit fixed_resampler(const rational_resampler& resampler);
+
+    int input_required(int noutput) const;
+
+    void operator()(
+        const int16_t* input, size_t n, std::vector<int32_t>& output);
+};
+
+/**
+ * The delay line discriminator, low-pass filter and DC blocker, in
+ * fixed point.  After the slicer everything is 0 or 1, so the rest is
+ * done with integers: the filter has Q15 taps, so its output is Q15,
+ * and the DC blocker keeps its sums in 32-bit integers.
+ *
+ * The PLL only needs the sign of each sample, so both demodulators use
+ * this for it, and give the same bits.
+ */
+struct fixed_discriminator
+{
+    static const size_t BLOCK_SIZE = 1024;
+    static const int DC_BLOCKER_LENGTH = 1024;
+
+    // The first delay_ entries hold the sliced bits from the end of the
+    // previous block.
+    size_t delay_;
+    std::vector<unsigned char> sliced_;
+
+    // The first ntaps - 1 entries of filter_input_ hold the end of the
+    // previous block.
+    std::vector<int16_t> taps_;     ///< Low-pass taps, reversed, Q15.
+    std::vector<int16_t> filter_input_;
+
+    dc_blocker<int32_t> dc_blocker_;
+
+    /// A delay of @p delay samples and a low-pass @p cutoff (Hz).
+    fixed_discriminator(int rate, double cutoff, size_t delay);
+
+    /**
+     * Discriminate @p n samples, no more than BLOCK_SIZE, appending the
+     * Q15 output to @p output.  Only the sign of the input is used.
+     */
+    template <typename T>
+    void operator()(const T* input, size_t n, std::vector<int32_t>& output);
+};
+
+/**
+ * Detects an AFSK1200 carrier by the share of the audio energy that is
+ * at the two tone frequencies, measured by a pair of Goertzel filters
+ * over windows of WINDOW_MS.  The share is about 0.3 for a clean AFSK
+ * signal and about 4 / N for white noise over a window of N samples.
+ * It does not depend on the audio level, so no noise floor has to be
+ * tracked.
+ */
+struct carrier_detector
+{
+    static const int WINDOW_MS = 5;
+    static const float DEFAULT_THRESHOLD;
+
+    int window_;            ///< Samples per window.
+    int count_;             ///< Samples so far in this window.
+    float coeff_[2];
+    float s1_[2];
+    float s2_[2];
+    float energy_;
+    float threshold_;
+    bool carrier_;
+    float tone_power_[2];   ///< At mark and space, over the last window.
+    float window_energy_;   ///< Of the last window.
+
+    carrier_detector(int rate, float threshold);
+
+    /// The number of samples left in the current window.
+    int remaining() const { return window_ - count_; }
+
+    /**
+     * Add @p n samples, no more than remaining().
+     *
+     * @return true if this completed a window, in which case carrier()
+     *  tells whether a carrier was seen in it.
+     */
+    bool operator()(const float* input, int n);
+
+    bool carrier() const { return carrier_; }
+};
+
+/**
+ * Correlates the input with a complex tone over a sliding window of
+ * the last N samples.  It costs O(1) per sample: each new product is
+ * added to the sum and the one from N samples ago is taken off.  The
+ * sum is kept in double precision so that rounding does not build up.
+ *
+ * The tone is kept as a table of one whole number of cycles, which for
+ * a tone of f Hz at r samples/second is r / gcd(r, f) samples long.
+ */
+struct tone_correlator
+{
+    std::vector<gr_complex> tone_;
+    size_t phase_;
+    std::vector<gr_complex> products_;  ///< The last N products.
+    size_t pos_;
+    std::complex<double> sum_;
+
+    tone_correlator(int rate, int frequency, int length);
+
+    /// Add the next sample and return the power at the tone.
+    float operator()(float x)
+    {
+        const gr_complex product = x * tone_[phase_];
+        if (++phase_ == tone_.size()) phase_ = 0;
+
+        sum_ += std::complex<double>(product - products_[pos_]);
+        products_[pos_] = product;
+        if (++pos_ == products_.size()) pos_ = 0;
+
+        return float(std::norm(sum_));
+    }
+};
+
+/**
+ * Packs bits eight to a byte, least significant bit first, which is the
+ * order hdlc_state_machine::push_byte() takes them in.
+ */
+struct bit_packer
+{
+    uint8_t bits_;
+    int count_;
+
+    bit_packer() : bits_(0), count_(0) {}
+
+    /// Add a @p bit.  If that completes a byte, put it in @p byte.
+    bool operator()(int bit, unsigned char& byte)
+    {
+        bits_ |= bit << count_;
+        if (++count_ != 8) return false;
+
+        byte = bits_;
+        bits_ = 0;
+        count_ = 0;
+        return true;
+    }
+};
+
+/**
+ * Digital PLL symbol timing recovery, as used by most software TNCs.
+ * The phase is a 32-bit fixed-point accumulator that goes once round
+ * per symbol.  A symbol is sampled each time the phase passes half way,
+ * and at each zero crossing of the input the phase is pulled towards
+ * zero by a shift, with no multiplies and no interpolation.
+ *
+ * The pull is strong (half the error) while searching, so the loop
+ * locks within a few flags, and weaker once transitions keep arriving
+ * within an eighth of a symbol of where they are expected.
+ *
+ * Between zero crossings the phase only advances, so the caller finds
+ * the next crossing or sampling point and moves the phase on by that
+ * many samples at once.
+ */
+struct symbol_pll
+{
+    static const int32_t ON_TIME = 1 << 29;    ///< An eighth of a symbol.
+    static const int SEARCH_SHIFT = 1;          ///< Keep 1/2 of the error.
+    static const int LOCKED_SHIFT = 2;          ///< Keep 3/4 of the error.
+    static const int LOCK_SCORE = 8;
+    static const int MAX_SCORE = 16;
+
+    uint32_t step_;
+    uint32_t phase_;
+    bool high_;     ///< Which side of the threshold the input is on.
+    int score_;     ///< Transitions on time, less twice those that are not.
+
+    symbol_pll(double samples_per_symbol)
+    : step_(uint32_t(4294967296.0 / samples_per_symbol + 0.5))
+    , phase_(0), high_(false), score_(0)
+    {}
+
+    bool locked() const { return score_ >= LOCK_SCORE; }
+
+    /// The number of samples, at least 1, up to the next sampling point.
+    size_t until_sample() const
+    {
+        uint64_t distance = uint32_t(0x80000000u - phase_);
+        if (distance == 0) distance = uint64_t(1) << 32;
+        return size_t((distance + step_ - 1) / step_);
+    }
+
+    /// Advance the phase by @p n samples.
+    void advance(size_t n)
+    {
+        phase_ += uint32_t(n) * step_;
+    }
+
+    /**
+     * The input has crossed the threshold at the current phase.
+     * Returns the timing error: the phase at the crossing, where a
+     * whole symbol is 2^32.
+     */
+    int32_t transition()
+    {
+        const int32_t error = int32_t(phase_);
+        const bool on_time = error < ON_TIME and error > -ON_TIME;
+        score_ = on_time ? std::min(score_ + 1, int(MAX_SCORE))
+            : std::max(score_ - 2, 0);
+
+        phase_ = uint32_t(error
+            - (error >> (locked() ? LOCKED_SHIFT : SEARCH_SHIFT)));
+        high_ = not high_;
+
+        return error;
+    }
+};
+
+/// What a quality_meter measured, up to a given bit.
+struct quality_report
+{
+    uint64_t bit;           ///< The bit reported at.
+    uint64_t sample;        ///< The input sample that bit was taken at.
+    float level;            ///< RMS audio level.
+    float timing_error;     ///< Mean magnitude of it, in symbols.
+    float twist;            ///< Mark over space tone power, in dB.
+    bool tones;             ///< Whether level and twist were measured.
+};
+
+/**
+ * Measures the signal as it is demodulated.  The audio level and the
+ * twist come from the carrier_detector windows, which cost nothing more
+ * while carrier detect is on, and are run for the meter alone while it
+ * is off.  Each window is kept until a report is made at a bit taken
+ * after it ended, so that the windows go with the bits they carried,
+ * however the input is split up.  The timing error is how far each
+ * transition is from halfway between two sampling points, in symbols:
+ * the PLL has it as the phase of the transition, and for Mueller &
+ * Müller it is interpolated between the two samples.
+ */
+struct quality_meter
+{
+    struct window
+    {
+        uint64_t end;       ///< The input sample just after it.
+        float energy;
+        int samples;
+        float mark;
+        float space;
+    };
+
+    std::vector<window> windows_;
+    double timing_;
+    uint64_t timings_;
+
+    quality_meter() : windows_() { clear(); }
+
+    /// Start the timing error again.
+    void clear()
+    {
+        timing_ = 0;
+        timings_ = 0;
+    }
+
+    /// Add the window @p detector has just ended, before sample @p end.
+    void add_window(const carrier_detector& detector, uint64_t end)
+    {
+        const window w = {end, detector.window_energy_, detector.window_,
+            detector.tone_power_[0], detector.tone_power_[1]};
+        windows_.push_back(w);
+    }
+
+    void add_timing(float error)
+    {
+        timing_ += std::fabs(error);
+        ++timings_;
+    }
+
+    /// Report what has been measured at @p bit, and start again.
+    quality_report report(uint64_t bit, uint64_t sample);
+};
+
+/**
+ * The complete AFSK1200 demodulator.  This does the work that used to
+ * be done by a chain of ten blocks:
+ *
+ * - Hard limit the input (binary slicer).
+ * - XOR with the signal delayed by 448us (the discriminator).
+ * - Low-pass filter the discriminator output.
+ * - Remove the DC component (long form DC blocker).
+ * - Recover the symbol clock (Mueller & Müller).
+ * - Slice the symbols and invert them.
+ *
+ * With soft output on, the last stage instead gives each bit as a
+ * signed confidence: positive for a 1, negative for a 0, with a
+ * magnitude from 1 to 127 that grows with the distance of the symbol
+ * from the slicer threshold.
+ *
+ * Each stage is a faithful copy of the GNU Radio block it replaces, so
+ * the bits produced are the same as the ones produced by the original
+ * hierarchical block.
+ *
+ * The CORRELATOR type replaces the first four stages with a pair of
+ * sliding correlators, one symbol long, at the mark (1200 Hz) and
+ * space (2200 Hz) frequencies.  The symbol is the difference of their
+ * powers over their sum.  Since nothing is sliced before the symbol
+ * is formed, the amplitude of each tone counts, and since the powers
+ * are compared directly, twist (one tone louder than the other) shifts
+ * the symbol much less than it shifts the delay line discriminator.
+ *
+ * The PLL clock recovery replaces Mueller & Müller with symbol_pll.
+ * It samples the nearest symbol rather than interpolating, which at
+ * the working rate is within 1/40 of a symbol, and locks faster on the
+ * flags at the start of a packet.
+ *
+ * Because the clock recovery needs to look ahead into the filtered
+ * signal, the output of the DC blocker is buffered.  Only as much input
+ * is consumed as is needed to fill the requested output.
+ *
+ * If carrier detect is on, input with no carrier is not demodulated at
+ * all; only the last PREROLL_WINDOWS windows of it are kept.  When a
+ * carrier is seen, those are demodulated first, so that the DC blocker
+ * has settled on the audio just before the packet rather than on
+ * whatever was heard last.  Once the carrier has gone, demodulation
+ * goes on for HANG_WINDOWS windows, long enough to carry the end of
+ * the packet through the DC blocker.
+ *
+ * The input can be at any rate.  Unless it is already at the working
+ * rate, it is first resampled to it, so that the rest of the
+ * demodulator always sees the same number of samples per symbol and
+ * does as little work as it can.
+ *
+ * The front end (discriminator and low-pass filter) runs a stage at a
+ * time over blocks of up to BLOCK_SIZE samples.  The discriminator
+ * loops are simple enough for the compiler to vectorize, and the filter
+ * uses fir_filter_fff::filterN(), which is built on VOLK and so picks
+ * the best SIMD dot product for the CPU at run time.
+ *
+ * The DELAY_LINE type with the PLL, which only looks at the sign of
+ * each sample, uses fixed_discriminator instead, on the audio rounded
+ * to 16 bits.  With no bias, its bits are then exactly those of
+ * fixed_point_demodulator.
+ */
+struct afsk1200_demodulator
+{
+    typedef gr::filter::kernel::fir_filter_fff fir_filter_type;
+
+    static const int DC_BLOCKER_LENGTH =
+        fixed_discriminator::DC_BLOCKER_LENGTH;
+    static const size_t BLOCK_SIZE = fixed_discriminator::BLOCK_SIZE;
+    static const int WORKING_RATE = afsk1200_demod::WORKING_RATE;
+    static const int PREROLL_WINDOWS = 20;
+    static const int HANG_WINDOWS = 40;
+    static const int REPORT_INTERVAL = 64;
+    static const float SOFT_SCALE;
+
+    int rate_;              ///< The working rate.
+    float bias_;
+    bool soft_;
+    bool packed_;
+    bit_packer packer_;
+    int type_;              ///< An afsk1200_demod::demodulator_type.
+    int clock_;             ///< An afsk1200_demod::clock_recovery_type.
+
+    // Resampler from the input rate to the working rate.
+    bool resample_;
+    rational_resampler resampler_;
+    std::vector<float> resampled_;
+
+    // Discriminator.  The first delay_ entries hold the sliced bits
+    // from the end of the previous block.
+    size_t delay_;
+    std::vector<unsigned char> sliced_;
+
+    // Low-pass filter.  The first ntaps - 1 entries of filter_input_
+    // hold the end of the previous block.
+    fir_filter_type filter_;
+    std::vector<float> filter_input_;
+    std::vector<float> filter_output_;
+
+    dc_blocker<float> dc_blocker_;
+
+    // Fixed point, used instead of the above for the PLL: the resampler
+    // and discriminator, and their input and output.
+    bool fixed_point_;
+    fixed_resampler fixed_resampler_;
+    fixed_discriminator discriminator_;
+    std::vector<int16_t> rounded_;
+    std::vector<int32_t> fixed_resampled_;
+    std::vector<int32_t> discriminated_;
+
+    // Correlators, used instead of the above for the CORRELATOR type.
+    tone_correlator mark_;
+    tone_correlator space_;
+
+    // Clock recovery.
+    gri_mmse_fir_interpolator_ff interp_;
+    std::vector<float> filtered_;
+    size_t index_;
+    float mu_;
+    float omega_;
+    float omega_mid_;
+    float omega_lim_;
+    float gain_mu_;
+    float gain_omega_;
+    float last_sample_;
+    symbol_pll pll_;
+
+    // Carrier detect, run on the input before it is resampled.  While
+    // the demodulator is idle, input goes into the pre-roll ring.
+    carrier_detector detector_;
+    bool carrier_detect_;
+    bool active_;
+    int hang_;                  ///< Windows left before going idle.
+    std::vector<float> preroll_;
+    size_t preroll_pos_;        ///< Where the next sample goes.
+    size_t preroll_size_;
+    uint64_t received_;
+    uint64_t skipped_;
+
+    // Quality reports.  The clock recovery takes its symbols from
+    // filtered_, which starts at working sample base_; the last input
+    // fed started at input sample fed_input_ and working sample
+    // fed_working_.
+    bool reporting_;
+    quality_meter meter_;
+    std::vector<quality_report> reports_;
+    uint64_t symbols_;          ///< Bits output.
+    uint64_t base_;
+    uint64_t fed_input_;
+    uint64_t fed_working_;
+
+    /**
+     * The defaults give the standard demodulator.  The diversity
+     * receiver runs variants with a different low-pass @p cutoff (Hz),
+     * discriminator @p delay (seconds) and @p bias, which is subtracted
+     * from each symbol before it is sliced.
+     *
+     * Input at @p rate is resampled to @p working_rate.  If that is 0
+     * the input is used as is, and the bits are the same as those of
+     * the original block.  The @p cutoff and @p delay only apply
+     * to the DELAY_LINE @p type.  The @p clock recovery is one of the
+     * afsk1200_demod::clock_recovery_type.
+     */
+    afsk1200_demodulator(int rate, double cutoff = 1200,
+        double delay = .000448, float bias = 0,
+        int working_rate = WORKING_RATE,
+        int type = afsk1200_demod::DELAY_LINE,
+        int clock = afsk1200_demod::MUELLER_MULLER);
+
+    /// The rate at which the demodulator runs.
+    int working_rate() const { return rate_; }
+
+    /// A resampler from @p rate to @p working_rate.
+    static rational_resampler make_resampler(int rate, int working_rate);
+
+    /// The nominal number of samples per symbol.
+    float samples_per_symbol() const { return omega_mid_; }
+
+    /// The number of input samples needed to produce @p noutput bits.
+    int input_required(int noutput) const;
+
+    /**
+     * Turn carrier detect on, with the given threshold for the share of
+     * the energy at the tone frequencies, or off if @p threshold is 0.
+     * It is off by default.  Changing the threshold alone leaves the
+     * gate open or shut as it is.  Turning carrier detect on shuts the
+     * gate until a carrier is heard, and turning it off opens it; both
+     * empty the preroll.
+     */
+    void set_carrier_threshold(float threshold);
+
+    /// The number of input samples received.
+    uint64_t received() const { return received_; }
+
+    /// The number of input samples skipped for want of a carrier.
+    uint64_t skipped() const { return skipped_; }
+
+    /// Output soft bits rather than 0 and 1.  It is off by default.
+    void set_soft_output(bool soft) { soft_ = soft; }
+
+    /**
+     * Add a quality_report to reports_ every REPORT_INTERVAL bits.  The
+     * caller must take them as they come.  It is off by default.
+     */
+    void set_reporting(bool reporting) { reporting_ = reporting; }
+
+    /**
+     * Output hard bits packed eight to a byte, least significant bit
+     * first, rather than one to a byte.  It is off by default, and has
+     * no effect on soft bits.
+     */
+    void set_packed_output(bool packed) { packed_ = packed; }
+
+    /// The number of bits in each output byte.
+    int bits_per_output() const { return packed_ and not soft_ ? 8 : 1; }
+
+    /**
+     * Demodulate up to @p ninput samples from @p input, writing at most
+     * @p noutput bytes of bits to @p output.
+     *
+     * @param[out] consumed is set to the number of input samples used.
+     * @return the number of bytes written to @p output.
+     */
+    int operator()(
+        const float* input, int ninput,
+        unsigned char* output, int noutput,
+        int& consumed);
+
+private:
+
+    int input_wanted(int noutput) const;
+    void feed(const float* input, size_t n, uint64_t first);
+    void feed_fixed(const float* input, size_t n);
+    int recover(unsigned char* output, int noutput);
+    void front_end(const float* input, size_t n);
+    template <typename T> void fixed_front_end(const T* input, size_t n);
+    void correlate(const float* input, size_t n);
+
+    void measure(const float* input, int n, uint64_t first);
+    void update_carrier(uint64_t end);
+    void save_preroll(const float* input, size_t n);
+    void feed_preroll(uint64_t end);
+
+    /// Count a bit output, taken from filtered_[@p position].
+    void count_symbol(size_t position)
+    {
+        if (symbols_++ % REPORT_INTERVAL == 0) report(position);
+    }
+
+    void report(size_t position);
+
+    static float slice(float x) { return x < 0 ? -1.0F : 1.0F; }
+
+    /// Output a @p symbol as a soft, hard or packed bit.  Returns the
+    /// number of bytes written.
+    int output_symbol(unsigned char* output, float symbol);
+
+    /// The soft bit for a symbol @p x above the slicer threshold.
+    static unsigned char soft_bit(float x)
+    {
+        const int confidence = std::max(1,
+            std::min(127, int(std::fabs(x) * SOFT_SCALE)));
+        return (unsigned char)(int8_t(x > 0 ? confidence : -confidence));
+    }
+};
+
+/**
+ * The DELAY_LINE demodulator with PLL clock recovery, in fixed point
+ * for 16-bit input, for CPUs without fast floating point.
+ *
+ * - The resampler has Q15 taps; only the sign of its output is used.
+ * - fixed_discriminator slices, XORs, filters and blocks DC.
+ * - symbol_pll recovers the clock from the Q15 symbols.
+ *
+ * afsk1200_demodulator runs the same stages for the PLL, so given the
+ * same 16-bit audio as floats, with the same settings and no bias, it
+ * gives exactly the same bits.  There is no carrier detect.
+ */
+struct fixed_point_demodulator
+{
+    static const int Q15 = 1 << 15;
+    static const size_t BLOCK_SIZE = fixed_discriminator::BLOCK_SIZE;
+
+    int rate_;              ///< The working rate.
+    int32_t bias_;          ///< Q15.
+    bool soft_;
+    bool packed_;
+    bit_packer packer_;
+
+    bool resample_;
+    fixed_resampler resampler_;
+    std::vector<int32_t> resampled_;
+
+    fixed_discriminator discriminator_;
+
+    std::vector<int32_t> filtered_;
+    size_t index_;
+    double omega_;
+    symbol_pll pll_;
+    uint64_t received_;
+
+    /// As for afsk1200_demodulator.
+    fixed_point_demodulator(int rate, double cutoff = 1200,
+        double delay = .000448, float bias = 0,
+        int working_rate = afsk1200_demodulator::WORKING_RATE);
+
+    int working_rate() const { return rate_; }
+
+    /// The number of input samples needed to produce @p noutput bits.
+    int input_required(int noutput) const;
+
+    /// The number of input samples received.
+    uint64_t received() const { return received_; }
+
+    /// Output soft bits rather than 0 and 1.  It is off by default.
+    void set_soft_output(bool soft) { soft_ = soft; }
+
+    /// As for afsk1200_demodulator.
+    void set_packed_output(bool packed) { packed_ = packed; }
+
+    int bits_per_output() const { return packed_ and not soft_ ? 8 : 1; }
+
+    /// As for afsk1200_demodulator.
+    int operator()(
+        const int16_t* input, int ninput,
+        unsigned char* output, int noutput,
+        int& consumed);
+
+private:
+
+    int input_wanted(int noutput) const;
+    void feed(const int16_t* input, size_t n);
+    int recover(unsigned char* output, int noutput);
+
+    /// The soft bit for a Q15 symbol @p x above the slicer threshold.
+    static unsigned char soft_bit(int32_t x)
+    {
+        const int confidence = std::max(1, std::min(127,
+            int((int64_t(x < 0 ? -x : x) * 254) >> 15)));
+        return (unsigned char)(int8_t(x > 0 ? confidence : -confidence));
+    }
+
+    int output_symbol(unsigned char* output, int32_t symbol);
+};
+
+} // detail
+
 class MOBILINKD_API afsk1200_demod_impl : public virtual afsk1200_demod
 {
 public:
     typedef boost::shared_ptr<afsk1200_demod_impl> sptr;
 
-    static sptr make(int rate)
+    static sptr make(int rate, int working_rate, bool soft,
+        int type, int clock, bool fixed_point, bool packed)
     {
-        return sptr(new afsk1200_demod_impl(rate));
+        return sptr(new afsk1200_demod_impl(
+            rate, working_rate, soft, type, clock, fixed_point, packed));
     }
 
+    virtual void forecast(int noutput_items, gr_vector_int& ninput_items_required);
+
+    virtual int general_work(
+        int noutput_items,
+        gr_vector_int& ninput_items,
+        gr_vector_const_void_star& input_items,
+        gr_vector_void_star& output_items);
+
+    virtual void set_carrier_threshold(float threshold);
+
+    virtual afsk1200_demod_stats get_stats() const;
+
     virtual ~afsk1200_demod_impl();
 
 private:
 
     int rate_;
+    /// One or the other, as chosen at make().
+    boost::shared_ptr<detail::afsk1200_demodulator> demod_;
+    boost::shared_ptr<detail::fixed_point_demodulator> fixed_;
+    pmt::pmt_t quality_key_;
+    pmt::pmt_t sample_key_;
+    pmt::pmt_t level_key_;
+    pmt::pmt_t timing_error_key_;
+    pmt::pmt_t twist_key_;
+
+    afsk1200_demod_impl(int rate, int working_rate, bool soft,
+        int type, int clock, bool fixed_point, bool packed);
+
+    /// Tag the output with the quality reports from the demodulator.
+    void publish_reports();
+
+    enum stat
+    {
+        SAMPLES_IN, SAMPLES_SKIPPED, BITS_OUT,
+        WORK_CALLS, WORK_NS, MAX_WORK_NS, NSTATS
+    };
+
+    detail::block_stats<NSTATS> stats_;
+    uint64_t skipped_;      ///< demod_->skipped() as last counted.
 
-    afsk1200_demod_impl(int rate);
+    /// A threshold set from another thread, for general_work() to apply.
+    static const float NO_THRESHOLD;
+    boost::atomic<float> threshold_;
 
 };
 
@@ -0,0 +1,259 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#include "afsk1200_diversity_rx_impl.h"
+#include "ax25_frame_view.h"
+
+#include <gnuradio/gr_io_signature.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace gr { namespace mobilinkd {
+
+afsk1200_diversity_rx::sptr afsk1200_diversity_rx::make(
+    int rate, int variants, int threads,
+    gr_msg_queue_sptr msgq, int output, int channel)
+{
+    return afsk1200_diversity_rx_impl::make(
+        rate, variants, threads, msgq, output, channel);
+}
+
+
+namespace detail {
+
+namespace {
+
+/**
+ * The variants, best first.  The first is the standard demodulator.
+ * The rest widen or narrow the filter (for more or less de-emphasis),
+ * move the discriminator delay, and bias the slicer against twist.
+ */
+const diversity_settings DIVERSITY_SETTINGS[] =
+{
+    {1200, .000448,  0.0F},
+    {1000, .000448,  0.0F},
+    {1500, .000448,  0.0F},
+    {1200, .000448,  0.05F},
+    {1200, .000448, -0.05F},
+    {1200, .000416,  0.0F},
+    {1200, .000480,  0.0F},
+    {1000, .000416,  0.05F},
+    {1500, .000480, -0.05F},
+};
+
+} // namespace
+
+} // detail
+
+
+afsk1200_diversity_rx_impl::afsk1200_diversity_rx_impl(
+    int rate, int variants, int threads,
+    gr_msg_queue_sptr msgq, int output, int channel)
+: gr_sync_block("afsk1200_diversity_rx",
+    gr_make_io_signature(1, 1, sizeof(float)),
+    gr_make_io_signature(0, 0, 0))
+, msgq_(msgq), log_()
+, output_(output), channel_(channel), rate_(rate)
+, window_(uint64_t(DEDUPE_BITS) * WORKING_RATE / 1200)
+, resampler_(detail::afsk1200_demodulator::make_resampler(rate, WORKING_RATE))
+, resampled_(), resampled_count_(0)
+, variants_()
+, nworkers_(std::max(1, std::min(threads, variants)))
+, input_(0), ninput_(0), offset_(0)
+, start_(nworkers_), finish_(nworkers_), stopping_(false), workers_()
+, recent_(), duplicates_(0)
+, pdu_port_(pmt::pmt_intern("pdus"))
+, crc_ok_key_(pmt::pmt_intern("crc_ok"))
+, offset_key_(pmt::pmt_intern("offset"))
+, channel_key_(pmt::pmt_intern("channel"))
+, destination_key_(pmt::pmt_intern("destination"))
+, source_key_(pmt::pmt_intern("source"))
+, variant_key_(pmt::pmt_intern("variant"))
+{
+    if (variants < 1 or variants > MAX_VARIANTS)
+    {
+        throw std::invalid_argument(
+            "afsk1200_diversity_rx: bad number of variants");
+    }
+
+    variants_.reserve(variants);
+    for (int i = 0; i != variants; ++i)
+    {
+        const detail::diversity_settings& settings =
+            detail::DIVERSITY_SETTINGS[i];
+        variants_.push_back(boost::shared_ptr<detail::afsk1200_receiver>(
+            new detail::afsk1200_receiver(i, WORKING_RATE,
+                settings.cutoff, settings.delay, settings.bias, 0)));
+    }
+
+    message_port_register_out(pdu_port_);
+
+    for (int i = 1; i < nworkers_; ++i)
+    {
+        workers_.create_thread(
+            boost::bind(&afsk1200_diversity_rx_impl::run_worker, this, i));
+    }
+}
+
+
+afsk1200_diversity_rx_impl::~afsk1200_diversity_rx_impl()
+{
+    if (nworkers_ > 1)
+    {
+        stopping_ = true;
+        start_.wait();
+        workers_.join_all();
+    }
+}
+
+
+void afsk1200_diversity_rx_impl::run_worker(int worker)
+{
+    for (;;)
+    {
+        start_.wait();
+        if (stopping_) return;
+        run_variants(worker);
+        finish_.wait();
+    }
+}
+
+
+void afsk1200_diversity_rx_impl::run_variants(int worker)
+{
+    for (size_t i = worker; i < variants_.size(); i += nworkers_)
+    {
+        (*variants_[i])(input_, ninput_, offset_);
+    }
+}
+
+
+int afsk1200_diversity_rx_impl::work(
+    int size,
+    gr_vector_const_void_star& input_items,
+    gr_vector_void_star& output_items)
+{
+    const float* source = reinterpret_cast<const float*>(input_items[0]);
+
+    resampled_.clear();
+    resampler_(source, size, resampled_);
+    if (resampled_.empty()) return size;
+
+    input_ = &resampled_[0];
+    ninput_ = resampled_.size();
+    offset_ = resampled_count_;
+    resampled_count_ += resampled_.size();
+
+    if (nworkers_ > 1) start_.wait();
+    run_variants(0);
+    if (nworkers_ > 1) finish_.wait();
+
+    merge_frames();
+
+    return size;
+}
+
+
+void afsk1200_diversity_rx_impl::merge_frames()
+{
+    std::vector<const decoded_frame*> frames;
+
+    for (size_t i = 0; i != variants_.size(); ++i)
+    {
+        const std::vector<decoded_frame>& decoded = variants_[i]->frames_;
+        for (size_t j = 0; j != decoded.size(); ++j)
+        {
+            frames.push_back(&decoded[j]);
+        }
+    }
+
+    std::sort(frames.begin(), frames.end(), earlier);
+
+    const log_sink::sptr log = boost::atomic_load(&log_);
+    for (size_t i = 0; i != frames.size(); ++i)
+    {
+        const decoded_frame& frame = *frames[i];
+
+        if (is_duplicate(frame))
+        {
+            duplicates_.fetch_add(1, boost::memory_order_relaxed);
+            continue;
+        }
+
+        if (log) log->frame(frame.data->data(), frame.data->size(), true);
+
+        if (output_ & hdlc_framer::PDU_OUTPUT)
+        {
+            send_pdu(frame);
+        }
+
+        if (output_ & hdlc_framer::TEXT_OUTPUT)
+        {
+            send_text(frame);
+        }
+    }
+
+    for (size_t i = 0; i != variants_.size(); ++i)
+    {
+        variants_[i]->clear_frames();
+    }
+}
+
+
+bool afsk1200_diversity_rx_impl::is_duplicate(const decoded_frame& frame)
+{
+    // Frames arrive roughly in order, so anything more than a window
+    // older than this frame can be forgotten.
+    while (not recent_.empty()
+        and recent_.front().second + window_ < frame.offset)
+    {
+        recent_.pop_front();
+    }
+
+    for (size_t i = 0; i != recent_.size(); ++i)
+    {
+        if (recent_[i].first == frame.crc) return true;
+    }
+
+    recent_.push_back(std::make_pair(frame.crc, frame.offset));
+
+    return false;
+}
+
+
+void afsk1200_diversity_rx_impl::send_text(const decoded_frame& data)
+{
+    ax25_frame_view frame(data.data->data(), data.data->size(), data.crc);
+    std::ostringstream output;
+    write(output, frame);
+    gr_message_sptr msg = gr_make_message_from_string(output.str());
+
+    msgq_->insert_tail(msg);         // send it
+}
+
+
+void afsk1200_diversity_rx_impl::send_pdu(const decoded_frame& frame)
+{
+    pmt::pmt_t meta = pmt::pmt_make_dict();
+    meta = pmt::pmt_dict_add(meta, crc_ok_key_, pmt::pmt_from_bool(true));
+    meta = pmt::pmt_dict_add(meta, offset_key_,
+        pmt::pmt_from_uint64(frame.offset * rate_ / WORKING_RATE));
+    meta = pmt::pmt_dict_add(meta, channel_key_,
+        pmt::pmt_from_long(channel_));
+    meta = pmt::pmt_dict_add(meta, variant_key_,
+        pmt::pmt_from_long(frame.id));
+
+    meta = detail::add_addresses(meta, ax25_frame_view(
+        frame.data->data(), frame.data->size(), frame.crc),
+        destination_key_, source_key_);
+
+    pmt::pmt_t bytes = pmt::pmt_init_u8vector(frame.data->size(),
+        reinterpret_cast<const uint8_t*>(frame.data->data()));
+
+    message_port_pub(pdu_port_, pmt::pmt_cons(meta, bytes));
+}
+
+}} // gr::mobilinkd
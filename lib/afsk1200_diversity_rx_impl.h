@@ -0,0 +1,137 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#ifndef GR__MOBILINKD__AFSK1200_DIVERSITY_RX_IMPL_H_
+#define GR__MOBILINKD__AFSK1200_DIVERSITY_RX_IMPL_H_
+
+#include "afsk1200_diversity_rx.h"
+#include "afsk1200_receiver.h"
+
+#include <gruel/pmt.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+#include <deque>
+#include <utility>
+
+namespace gr { namespace mobilinkd {
+
+namespace detail {
+
+/// The demodulator settings of one diversity variant.
+struct diversity_settings
+{
+    double cutoff;      ///< Low-pass cutoff in Hz.
+    double delay;       ///< Discriminator delay in seconds.
+    float bias;         ///< Slicer bias.
+};
+
+} // detail
+
+class MOBILINKD_API afsk1200_diversity_rx_impl
+: public virtual afsk1200_diversity_rx
+{
+public:
+    typedef boost::shared_ptr<afsk1200_diversity_rx_impl> sptr;
+
+    static sptr make(int rate, int variants, int threads,
+        gr_msg_queue_sptr msgq, int output, int channel)
+    {
+        return sptr(new afsk1200_diversity_rx_impl(
+            rate, variants, threads, msgq, output, channel));
+    }
+
+    virtual int work(
+        int noutput_items,
+        gr_vector_const_void_star& input_items,
+        gr_vector_void_star& output_items);
+
+    virtual gr_msg_queue_sptr msgq() const { return msgq_; }
+
+    virtual void set_log_sink(log_sink::sptr sink)
+    {
+        boost::atomic_store(&log_, sink);
+    }
+
+    virtual unsigned long decoded(int variant) const
+    {
+        return variants_.at(variant)->decoded_.load(
+            boost::memory_order_relaxed);
+    }
+
+    virtual unsigned long duplicates() const
+    {
+        return duplicates_.load(boost::memory_order_relaxed);
+    }
+
+    virtual ~afsk1200_diversity_rx_impl();
+
+private:
+
+    typedef detail::afsk1200_receiver::decoded_frame decoded_frame;
+
+    afsk1200_diversity_rx_impl(int rate, int variants, int threads,
+        gr_msg_queue_sptr msgq, int output, int channel);
+
+    void run_worker(int worker);
+    void run_variants(int worker);
+    void merge_frames();
+    bool is_duplicate(const decoded_frame& frame);
+    void send_text(const decoded_frame& frame);
+    void send_pdu(const decoded_frame& frame);
+
+    static const int WORKING_RATE = afsk1200_demod::WORKING_RATE;
+
+    static bool earlier(const decoded_frame* a, const decoded_frame* b)
+    {
+        return a->offset < b->offset
+            or (a->offset == b->offset and a->id < b->id);
+    }
+
+    gr_msg_queue_sptr msgq_;
+    log_sink::sptr log_;
+    int output_;
+    int channel_;
+    int rate_;
+    uint64_t window_;
+
+    // The input is resampled to the working rate once, for all of the
+    // variants.  Frame offsets are counted in resampled samples.
+    detail::rational_resampler resampler_;
+    std::vector<float> resampled_;
+    uint64_t resampled_count_;
+
+    // The demodulators own FIR filters, which cannot be copied.
+    std::vector<boost::shared_ptr<detail::afsk1200_receiver> > variants_;
+
+    // The block being demodulated, shared with the workers.  Worker 0
+    // is the thread that calls work().
+    int nworkers_;
+    const float* input_;
+    int ninput_;
+    uint64_t offset_;
+    boost::barrier start_;
+    boost::barrier finish_;
+    boost::atomic<bool> stopping_;
+    boost::thread_group workers_;
+
+    // Frames sent recently, for finding duplicates.
+    std::deque<std::pair<uint16_t, uint64_t> > recent_;
+    boost::atomic<uint64_t> duplicates_;   ///< Read from any thread.
+
+    pmt::pmt_t pdu_port_;
+    pmt::pmt_t crc_ok_key_;
+    pmt::pmt_t offset_key_;
+    pmt::pmt_t channel_key_;
+    pmt::pmt_t destination_key_;
+    pmt::pmt_t source_key_;
+    pmt::pmt_t variant_key_;
+};
+
+}} // gr::mobilinkd
+
+#endif // GR__MOBILINKD__AFSK1200_DIVERSITY_RX_IMPL_H_
@@ -0,0 +1,54 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#include "afsk1200_receiver.h"
+
+namespace gr { namespace mobilinkd { namespace detail {
+
+void afsk1200_receiver::operator()(
+    const float* input, int ninput, uint64_t offset)
+{
+    int pos = 0;
+
+    while (pos != ninput)
+    {
+        int consumed = 0;
+        int produced = demod_(
+            input + pos, ninput - pos, &bits_[0], BLOCK_BYTES, consumed);
+
+        if (produced == 0 and consumed == 0) break;
+
+        int i = 0;
+        while (i != produced)
+        {
+            const int end = std::min(produced, i + 8);
+
+            if (end - i == 8)
+            {
+                uint64_t word = 0;
+                for (int j = 8; j-- != 0; ) word = (word << 8) | bits_[i + j];
+                i += framer_.push_word(word);
+            }
+
+            while (i != end)
+            {
+                if (not framer_.push_byte(bits_[i++])) continue;
+
+                // Place the frame in proportion to the samples used for
+                // these bits; close enough to compare with other receivers.
+                decoded_frame frame;
+                frame.crc = framer_.checksum();
+                frame.offset = offset + pos
+                    + uint64_t(consumed) * i / produced;
+                frame.id = id_;
+                frame.data = framer_.take_frame();
+                frames_.push_back(frame);
+                decoded_.fetch_add(1, boost::memory_order_relaxed);
+            }
+        }
+
+        pos += consumed;
+    }
+}
+
+}}} // gr::mobilinkd::detail
@@ -0,0 +1,75 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#ifndef GR__MOBILINKD__AFSK1200_RECEIVER_H_
+#define GR__MOBILINKD__AFSK1200_RECEIVER_H_
+
+#include "afsk1200_demod_impl.h"
+#include "hdlc_framer_impl.h"
+
+#include <boost/atomic.hpp>
+
+#include <string>
+#include <vector>
+
+namespace gr { namespace mobilinkd {
+
+namespace detail {
+
+/**
+ * An AFSK1200 demodulator and its HDLC deframer, for blocks that run
+ * more than one of them.  The frames decoded from each block of input
+ * are kept, with the input sample at which each one was completed,
+ * until the block that owns the receiver sends them.
+ */
+struct afsk1200_receiver
+{
+    struct decoded_frame
+    {
+        frame_buffer* data;     ///< Held until clear_frames().
+        uint16_t crc;
+        uint64_t offset;
+        int id;             ///< The id of the receiver that decoded it.
+    };
+
+    static const int BLOCK_BYTES = 128;
+
+    int id_;
+    afsk1200_demodulator demod_;
+    hdlc_state_machine framer_;
+    std::vector<unsigned char> bits_;   ///< Packed, eight to a byte.
+    std::vector<decoded_frame> frames_;
+    boost::atomic<uint64_t> decoded_;  ///< Read from any thread.
+
+    /// The demodulator arguments are as for afsk1200_demodulator.
+    afsk1200_receiver(int id, int rate, double cutoff = 1200,
+        double delay = .000448, float bias = 0,
+        int working_rate = afsk1200_demodulator::WORKING_RATE)
+    : id_(id)
+    , demod_(rate, cutoff, delay, bias, working_rate)
+    , framer_(false)
+    , bits_(BLOCK_BYTES), frames_(), decoded_(0)
+    {
+        demod_.set_packed_output(true);
+    }
+
+    /// Demodulate and deframe all @p ninput samples, the first of which
+    /// is input sample @p offset.
+    void operator()(const float* input, int ninput, uint64_t offset);
+
+    /// Give the frames decoded back to the framer once they are sent.
+    void clear_frames()
+    {
+        for (size_t i = 0; i != frames_.size(); ++i)
+        {
+            framer_.release_frame(frames_[i].data);
+        }
+        frames_.clear();
+    }
+};
+
+} // detail
+
+}} // gr::mobilinkd
+
+#endif // GR__MOBILINKD__AFSK1200_RECEIVER_H_
@@ -4,8 +4,10 @@
 #ifndef GR__MOBILINKD__AX25_FRAME_H_
 #define GR__MOBILINKD__AX25_FRAME_H_
 
+#include "crc_ccitt.h"
+#include "callsign.h"
+
 #include <boost/scoped_ptr.hpp>
-#include <boost/crc.hpp>
 #include <boost/optional.hpp>
 #include <boost/lexical_cast.hpp>
 
@@ -28,12 +30,20 @@ struct bad_frame : std::runtime_error
     {}
 };
 
-template <bool STRICT>
-struct basic_ax25_frame
+/**
+ * An AX.25 frame, parsed once.  The parse policy says what to do with
+ * a frame whose FCS does not match its CRC: STRICT rejects it with
+ * bad_frame, while SLOPPY parses it anyway, replacing any unprintable
+ * characters in its addresses.  Either way crc_ok() keeps the verdict,
+ * so the frame never has to be parsed again to find it.
+ */
+struct ax25_frame
 {
     typedef std::vector<std::string> repeaters_type;
+    typedef std::vector<callsign> callsigns_type;
     typedef boost::optional<uint8_t> pid_type;
     enum frame_type {UNDEFINED, INFORMATION, SUPERVISORY, UNNUMBERED};
+    enum parse_policy {STRICT, SLOPPY};
 
 private:
 
@@ -46,6 +56,9 @@ private:
     std::string destination_;
     std::string source_;
     repeaters_type repeaters_;
+    callsign destination_call_;
+    callsign source_call_;
+    callsigns_type repeater_calls_;
     frame_type type_;
     uint8_t raw_type_;
     std::string info_;
@@ -96,7 +109,7 @@ private:
         return result;
     }
 
-    static bool fixup_address(std::string& address)
+    static bool fixup_address(std::string& address, parse_policy policy)
     {
         assert(address.size() == ADDRESS_LENGTH);
 
@@ -111,7 +124,7 @@ private:
         if (pos == std::string::npos) pos = 6;
         address.erase(pos);
 
-        if (!STRICT)
+        if (policy == SLOPPY)
         {
             address = cleanBadAddress(address);
         }
@@ -140,7 +153,7 @@ private:
     static std::string parse_info(const std::string& frame, size_t pos)
     {
         std::ostringstream output;
-        for (int i = pos; i != frame.size() - 2; i++)
+        for (size_t i = pos; i != frame.size() - 2; i++)
         {
             char c = frame[i];
             if (std::isprint(c))
@@ -164,26 +177,15 @@ private:
             ((uint8_t(frame[checksum_pos + 1]) << 8) |
                 uint8_t(frame[checksum_pos]));
 
-        uint16_t checksum = 0;
-        for (size_t i = 1; i != 0x10000; i <<= 1)
-        {
-            checksum <<= 1;
-            checksum |= ((tmp & i) ? 1 : 0);
-        }
-
-        return checksum;
+        return crc_ccitt::reverse(tmp);
     }
 
     static uint16_t compute_crc(const std::string& frame)
     {
         assert(frame.size() > 2);
 
-        const size_t payload_len = frame.size() - 2;
-
-        // Not exactly CRC16-CCITT because of final complement.
-        boost::crc_optimal<16, 0x1021, 0xFFFF, 0xFFFF, true, false> crc;
-
-        crc.process_bytes(frame.data(), payload_len);
+        crc_ccitt crc;
+        crc(frame.data(), frame.size());
 
         return crc.checksum();
     }
@@ -200,7 +202,14 @@ private:
         return frame.substr(SRC_ADDRESS_POS, ADDRESS_LENGTH);
     }
 
-    static repeaters_type parse_repeaters(const std::string& frame)
+    static callsign parse_callsign(const std::string& frame, size_t pos)
+    {
+        return callsign::from_field(
+            reinterpret_cast<const uint8_t*>(frame.data()) + pos);
+    }
+
+    static repeaters_type parse_repeaters(const std::string& frame,
+        callsigns_type& calls, parse_policy policy)
     {
         assert(frame[LAST_ADDRESS_POS] & 1);
 
@@ -211,8 +220,9 @@ private:
         while (more)
         {
             std::string repeater = frame.substr(index, ADDRESS_LENGTH);
+            calls.push_back(parse_callsign(frame, index));
             index += ADDRESS_LENGTH;
-            more = fixup_address(repeater)
+            more = fixup_address(repeater, policy)
                 and (index + ADDRESS_LENGTH) < frame.length();
             result.push_back(repeater);
         }
@@ -220,24 +230,30 @@ private:
         return result;
     }
 
-    void parse(const std::string& frame)
+    void parse(const std::string& frame, const uint16_t* crc,
+        parse_policy policy)
     {
         if (frame.length() < 17) return;
 
         fcs_ = parse_fcs(frame);
-        crc_ = compute_crc(frame);
+        crc_ = crc ? *crc : compute_crc(frame);
 
-        if (STRICT and (fcs_ != crc_)) throw bad_frame("crc mismatch");
+        if (policy == STRICT and (fcs_ != crc_))
+        {
+            throw bad_frame("crc mismatch");
+        }
 
         destination_ = parse_destination(frame);
-        fixup_address(destination_);
+        fixup_address(destination_, policy);
+        destination_call_ = parse_callsign(frame, DEST_ADDRESS_POS);
 
         source_ = parse_source(frame);
-        bool have_repeaters = fixup_address(source_);
+        bool have_repeaters = fixup_address(source_, policy);
+        source_call_ = parse_callsign(frame, SRC_ADDRESS_POS);
 
         if (have_repeaters)
         {
-            repeaters_ = parse_repeaters(frame);
+            repeaters_ = parse_repeaters(frame, repeater_calls_, policy);
         }
 
         size_t index = ADDRESS_LENGTH * (repeaters_.size() + 2);
@@ -254,48 +270,99 @@ private:
 
 public:
 
-    basic_ax25_frame(const std::string& frame)
+    ax25_frame(const std::string& frame, parse_policy policy = STRICT)
+    : destination_()
+    , source_()
+    , repeaters_()
+    , destination_call_()
+    , source_call_()
+    , repeater_calls_()
+    , type_(UNDEFINED)
+    , info_()
+    , fcs_(-1), crc_(0)
+    , pid_()
+    {
+        parse(frame, 0, policy);
+    }
+
+    /**
+     * Parse a frame whose CRC has already been computed, such as by the
+     * HDLC state machine as the frame was received.
+     */
+    ax25_frame(const std::string& frame, uint16_t crc,
+        parse_policy policy = STRICT)
     : destination_()
     , source_()
     , repeaters_()
+    , destination_call_()
+    , source_call_()
+    , repeater_calls_()
     , type_(UNDEFINED)
     , info_()
     , fcs_(-1), crc_(0)
     , pid_()
     {
-        parse(frame);
+        parse(frame, &crc, policy);
     }
 
-    std::string destination() const { return destination_; }
+    const std::string& destination() const { return destination_; }
+
+    const std::string& source() const { return source_; }
+
+    const repeaters_type& repeaters() const { return repeaters_; }
 
-    std::string source() const { return source_; }
+    callsign destination_call() const { return destination_call_; }
 
-    repeaters_type repeaters() const { return repeaters_; }
+    callsign source_call() const { return source_call_; }
+
+    const callsigns_type& repeater_calls() const { return repeater_calls_; }
 
     frame_type type() const { return type_; }
 
-    std::string info() const { return info_; }
+    const std::string& info() const { return info_; }
 
     uint16_t fcs() const { return fcs_; }
 
     uint16_t crc() const { return crc_; }
 
     pid_type pid() const { return pid_; }
+
+    /// Whether the FCS sent with the frame matches its CRC.
+    bool crc_ok() const { return fcs_ == crc_; }
+};
+
+/// An ax25_frame parsed with the STRICT policy.
+struct strict_ax25_frame : ax25_frame
+{
+    strict_ax25_frame(const std::string& frame)
+    : ax25_frame(frame, STRICT)
+    {}
+
+    strict_ax25_frame(const std::string& frame, uint16_t crc)
+    : ax25_frame(frame, crc, STRICT)
+    {}
 };
 
-typedef basic_ax25_frame<true> strict_ax25_frame;
-typedef basic_ax25_frame<false> sloppy_ax25_frame;
-typedef strict_ax25_frame ax25_frame;
+/// An ax25_frame parsed with the SLOPPY policy.
+struct sloppy_ax25_frame : ax25_frame
+{
+    sloppy_ax25_frame(const std::string& frame)
+    : ax25_frame(frame, SLOPPY)
+    {}
+
+    sloppy_ax25_frame(const std::string& frame, uint16_t crc)
+    : ax25_frame(frame, crc, SLOPPY)
+    {}
+};
 
-template <bool STRICT>
-void write(std::ostream& os, const basic_ax25_frame<STRICT>& frame)
+inline void write(std::ostream& os, const ax25_frame& frame)
 {
-    typedef typename basic_ax25_frame<STRICT>::repeaters_type repeaters_type;
+    typedef ax25_frame::repeaters_type repeaters_type;
 
     os << "Dest: " << frame.destination() << std::endl
         << "Source: " << frame.source() << std::endl;
 
-    repeaters_type repeaters = frame.repeaters();
+    const repeaters_type& repeaters = frame.repeaters();
     if (!repeaters.empty())
     {
         os << "Via: ";
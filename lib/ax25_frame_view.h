@@ -0,0 +1,238 @@
+// Copyright 2012 Robert C. Riggs <rob@pangalactic.org>
+// All rights reserved.
+
+#ifndef GR__MOBILINKD__AX25_FRAME_VIEW_H_
+#define GR__MOBILINKD__AX25_FRAME_VIEW_H_
+
+#include "ax25_frame.h"
+#include "crc_ccitt.h"
+#include "callsign.h"
+
+#include <iostream>
+#include <iomanip>
+#include <cctype>
+#include <cassert>
+#include <stdint.h>
+
+namespace gr { namespace mobilinkd {
+
+/**
+ * A non-owning view over a received AX.25 frame, FCS included.  Nothing
+ * is copied or allocated: only the repeaters are counted when the view
+ * is made, and each address is decoded into a callsign when it is asked
+ * for.  The frame must outlive the view.
+ *
+ * Fields are found by the same rules as ax25_frame, so the two agree
+ * on every frame.  Unlike ax25_frame, the view never rejects a frame;
+ * check crc_ok() where that matters.
+ */
+class ax25_frame_view
+{
+public:
+
+    typedef ax25_frame::frame_type frame_type;
+    typedef ax25_frame::pid_type pid_type;
+
+    static const size_t MIN_SIZE = 17;
+    static const size_t ADDRESS_LENGTH = 7;
+
+    ax25_frame_view(const char* data, size_t size)
+    : data_(reinterpret_cast<const uint8_t*>(data)), size_(size)
+    , repeaters_(0), control_(0), crc_(0), have_crc_(false)
+    {
+        find_control();
+    }
+
+    /**
+     * View a frame whose CRC has already been computed, such as by the
+     * HDLC state machine as the frame was received.
+     */
+    ax25_frame_view(const char* data, size_t size, uint16_t crc)
+    : data_(reinterpret_cast<const uint8_t*>(data)), size_(size)
+    , repeaters_(0), control_(0), crc_(crc), have_crc_(true)
+    {
+        find_control();
+    }
+
+    /// Whether the frame is long enough to hold its address fields.
+    bool valid() const { return size_ >= MIN_SIZE; }
+
+    const char* data() const { return reinterpret_cast<const char*>(data_); }
+
+    size_t size() const { return size_; }
+
+    callsign destination() const { return address(DEST_ADDRESS_POS); }
+
+    callsign source() const { return address(SRC_ADDRESS_POS); }
+
+    size_t repeater_count() const { return repeaters_; }
+
+    callsign repeater(size_t i) const
+    {
+        assert(i < repeaters_);
+        return address(FIRST_REPEATER_POS + i * ADDRESS_LENGTH);
+    }
+
+    frame_type type() const
+    {
+        if (not has_control()) return ax25_frame::UNDEFINED;
+
+        switch (data_[control_] & 0x03)
+        {
+        case 1:
+            return ax25_frame::SUPERVISORY;
+        case 3:
+            return ax25_frame::UNNUMBERED;
+        default:
+            return ax25_frame::INFORMATION;
+        }
+    }
+
+    pid_type pid() const
+    {
+        if (type() != ax25_frame::UNNUMBERED) return pid_type();
+        return pid_type(data_[control_ + 1]);
+    }
+
+    /// The information field, or 0 if there is none.
+    const char* info() const
+    {
+        return has_control() ? data() + info_pos() : 0;
+    }
+
+    size_t info_size() const
+    {
+        return has_control() ? size_ - 2 - info_pos() : 0;
+    }
+
+    /// The FCS sent with the frame, as ax25_frame::fcs().
+    uint16_t fcs() const
+    {
+        if (not valid()) return 0xFFFF;
+        return crc_ccitt::reverse((data_[size_ - 1] << 8) | data_[size_ - 2]);
+    }
+
+    /// The CRC of the frame, as ax25_frame::crc().
+    uint16_t crc() const
+    {
+        if (not valid()) return 0;
+        if (have_crc_) return crc_;
+
+        crc_ccitt crc;
+        crc(data(), size_);
+        return crc.checksum();
+    }
+
+    /// Whether the FCS sent with the frame matches its CRC.
+    bool crc_ok() const { return fcs() == crc(); }
+
+private:
+
+    static const size_t DEST_ADDRESS_POS = 0;
+    static const size_t SRC_ADDRESS_POS = 7;
+    static const size_t LAST_ADDRESS_POS = 13;
+    static const size_t FIRST_REPEATER_POS = 14;
+
+    callsign address(size_t pos) const
+    {
+        return valid() ? callsign::from_field(data_ + pos) : callsign();
+    }
+
+    /**
+     * Count the repeaters, stopping at the last address or when there
+     * is no room left for another.  The control field follows them.
+     */
+    void find_control()
+    {
+        if (not valid()) return;
+
+        size_t index = FIRST_REPEATER_POS;
+        bool more = (data_[LAST_ADDRESS_POS] & 1) == 0
+            and (index + ADDRESS_LENGTH) < size_;
+
+        while (more)
+        {
+            more = (data_[index + ADDRESS_LENGTH - 1] & 1) == 0;
+            index += ADDRESS_LENGTH;
+            more = more and (index + ADDRESS_LENGTH) < size_;
+            ++repeaters_;
+        }
+
+        control_ = index;
+    }
+
+    bool has_control() const
+    {
+        return valid() and size_ >= control_ + 5;
+    }
+
+    size_t info_pos() const
+    {
+        return control_ + (type() == ax25_frame::UNNUMBERED ? 2 : 1);
+    }
+
+    const uint8_t* data_;
+    size_t size_;
+    size_t repeaters_;
+    size_t control_;
+    uint16_t crc_;
+    bool have_crc_;
+};
+
+/**
+ * Write @p call as ax25_frame gives its addresses, such as "N0CALL-9".
+ * With the SLOPPY policy, unprintable characters are written as '?'.
+ */
+inline void write_address(std::ostream& os, const callsign& call,
+    ax25_frame::parse_policy policy)
+{
+    for (int shift = 44; shift >= 4; shift -= 8)
+    {
+        char c = char((call.value() >> shift) & 0xFF);
+        if (c == ' ') break;
+        if (policy == ax25_frame::SLOPPY and not std::isprint(c)) c = '?';
+        os << c;
+    }
+
+    if (call.ssid())
+    {
+        os << '-';
+        if (call.ssid() > 9) os << '1';
+        os << char('0' + call.ssid() % 10);
+    }
+}
+
+/// Write @p frame in the same form as write() does an ax25_frame.
+inline void write(std::ostream& os, const ax25_frame_view& frame,
+    ax25_frame::parse_policy policy = ax25_frame::SLOPPY)
+{
+    const bool valid = frame.valid();
+
+    os << "Dest: ";
+    if (valid) write_address(os, frame.destination(), policy);
+    os << std::endl << "Source: ";
+    if (valid) write_address(os, frame.source(), policy);
+    os << std::endl;
+
+    if (frame.repeater_count() != 0)
+    {
+        os << "Via: ";
+        for (size_t i = 0; i != frame.repeater_count(); ++i)
+        {
+            write_address(os, frame.repeater(i), policy);
+            os << ' ';
+        }
+        os << std::endl;
+    }
+
+    os << "PID: " << std::setbase(16) << frame.pid() << std::endl;
+    os << "Info: " << std::endl;
+    os.write(frame.info(), frame.info_size());
+    os << std::endl;
+    os << "FCS: " << frame.fcs() << std::endl;
+    os << "CRC: " << frame.crc() << std::endl;
+}
+
+}} // gr::mobilinkd
+
+#endif // GR__MOBILINKD__AX25_FRAME_VIEW_H_
@@ -0,0 +1,340 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+// Times the AFSK1200 demodulator on a minute of simulated packets.
+// Run it by hand, from a Release build:
+//
+//   lib/bench_afsk1200_demod
+
+#include "afsk1200_demod_impl.h"
+#include "hdlc_framer_impl.h"
+#include "test_signals.h"
+
+#include <gruel/high_res_timer.h>
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+
+using namespace gr::mobilinkd;
+
+namespace {
+
+const int SECONDS = 60;
+
+double seconds_since(gruel::high_res_timer_type start)
+{
+    return double(gruel::high_res_timer_now() - start)
+        / gruel::high_res_timer_tps();
+}
+
+void report(const std::string& name, double seconds, size_t samples)
+{
+    std::cout << "  " << std::left << std::setw(40) << name
+        << std::right << std::fixed << std::setprecision(2)
+        << std::setw(8) << seconds * 1e9 / samples << " ns/sample"
+        << std::endl;
+}
+
+/**
+ * Packets with a little noise between them, to fill SECONDS.  Each is
+ * led by @p flags flags, which the clock recovery has to lock on.
+ */
+test::bit_vector make_packets(
+    test::random_source& random, size_t& count, size_t flags = 30)
+{
+    test::bit_vector bits;
+    count = 0;
+    while (bits.size() < size_t(SECONDS * 1200))
+    {
+        test::append_noise(bits, 600, random);
+        test::append_flags(bits, flags);
+        test::append_frame(bits, test::make_frame(60, random));
+        test::append_flags(bits, 2);
+        ++count;
+    }
+    return bits;
+}
+
+/// Demodulate all of @p audio, a block at a time as general_work() would.
+template <typename Demodulator, typename Sample>
+size_t demodulate(Demodulator& demod, const std::vector<Sample>& audio)
+{
+    std::vector<unsigned char> output(4096);
+    size_t bits = 0;
+
+    for (size_t pos = 0; pos < audio.size(); )
+    {
+        const int n = int(std::min<size_t>(4096, audio.size() - pos));
+        int consumed = 0;
+        bits += demod(
+            &audio[pos], n, &output[0], int(output.size()), consumed);
+        if (consumed == 0) break;
+        pos += consumed;
+    }
+
+    return bits;
+}
+
+/**
+ * Demodulate @p audio, timing only the demodulator, and count the
+ * frames with a good FCS in its output.
+ */
+template <typename Demodulator, typename Sample>
+size_t decode(Demodulator& demod, const std::vector<Sample>& audio,
+    double& seconds)
+{
+    std::vector<unsigned char> bits;
+    std::vector<unsigned char> output(4096);
+
+    const gruel::high_res_timer_type start = gruel::high_res_timer_now();
+    for (size_t pos = 0; pos < audio.size(); )
+    {
+        const int n = int(std::min<size_t>(4096, audio.size() - pos));
+        int consumed = 0;
+        const int produced = demod(
+            &audio[pos], n, &output[0], int(output.size()), consumed);
+        bits.insert(bits.end(), output.begin(), output.begin() + produced);
+        if (consumed == 0) break;
+        pos += consumed;
+    }
+    seconds = seconds_since(start);
+
+    detail::hdlc_state_machine framer(false);
+    size_t frames = 0;
+    for (size_t i = 0; i != bits.size(); ++i)
+    {
+        if (framer(bits[i]))
+        {
+            framer.clear_frame();
+            ++frames;
+        }
+    }
+    return frames;
+}
+
+void report(const std::string& name, double seconds, size_t samples,
+    size_t frames, size_t sent)
+{
+    std::cout << "  " << std::left << std::setw(40) << name
+        << std::right << std::fixed << std::setprecision(2)
+        << std::setw(8) << seconds * 1e9 / samples << " ns/sample"
+        << std::setw(6) << frames << "/" << sent << " frames" << std::endl;
+}
+
+/**
+ * The low-pass filter, with the taps the demodulator uses, run a sample
+ * at a time with filter() and a block at a time with filterN().  Both
+ * are built on VOLK; filterN() saves the call and set up per sample.
+ */
+void bench_filter(const std::vector<float>& audio)
+{
+    typedef detail::afsk1200_demodulator demodulator;
+
+    demodulator demod(afsk1200_demod::WORKING_RATE);
+    const std::vector<float> taps = demod.filter_.taps();
+    demodulator::fir_filter_type filter(1, taps);
+
+    std::vector<float> input(taps.size() - 1, 0);
+    input.insert(input.end(), audio.begin(), audio.end());
+    std::vector<float> output(audio.size());
+
+    std::cout << "Low-pass filter, " << taps.size() << " taps:" << std::endl;
+
+    gruel::high_res_timer_type start = gruel::high_res_timer_now();
+    for (size_t i = 0; i != audio.size(); ++i)
+    {
+        output[i] = filter.filter(&input[i]);
+    }
+    report("filter(), a sample at a time", seconds_since(start),
+        audio.size());
+
+    start = gruel::high_res_timer_now();
+    for (size_t i = 0; i < audio.size(); i += demodulator::BLOCK_SIZE)
+    {
+        filter.filterN(&output[i], &input[i],
+            std::min(audio.size() - i, demodulator::BLOCK_SIZE));
+    }
+    report("filterN(), BLOCK_SIZE at a time", seconds_since(start),
+        audio.size());
+}
+
+void bench_rates(const test::bit_vector& bits, test::random_source& random)
+{
+    const int rates[] = {22050, 24000, 44100, 48000};
+
+    std::cout << "Demodulator, by input rate:" << std::endl;
+
+    for (size_t i = 0; i != sizeof(rates) / sizeof(rates[0]); ++i)
+    {
+        const std::vector<float> audio =
+            test::modulate(bits, rates[i], 1.0, 0.1, random);
+
+        detail::afsk1200_demodulator demod(rates[i]);
+        const gruel::high_res_timer_type start =
+            gruel::high_res_timer_now();
+        demodulate(demod, audio);
+
+        std::ostringstream name;
+        name << rates[i] << " Hz";
+        report(name.str(), seconds_since(start), audio.size());
+    }
+}
+
+/**
+ * A quiet channel -- a minute of noise -- and a busy one, with
+ * carrier detect off and on.  With it on, the audio with no carrier in
+ * it is skipped rather than demodulated.
+ */
+void bench_idle(const test::bit_vector& bits, test::random_source& random)
+{
+    const int rate = 48000;
+
+    std::vector<float> noise(size_t(SECONDS) * rate);
+    for (size_t i = 0; i != noise.size(); ++i)
+    {
+        noise[i] = 0.3F * random.uniform();
+    }
+    const std::vector<float> packets =
+        test::modulate(bits, rate, 1.0, 0.1, random);
+
+    std::cout << "Carrier detect, " << rate << " Hz:" << std::endl;
+
+    const float thresholds[] = {
+        0, detail::carrier_detector::DEFAULT_THRESHOLD
+    };
+    for (size_t i = 0; i != 2; ++i)
+    {
+        for (int busy = 0; busy != 2; ++busy)
+        {
+            const std::vector<float>& audio = busy ? packets : noise;
+
+            detail::afsk1200_demodulator demod(rate);
+            demod.set_carrier_threshold(thresholds[i]);
+            const gruel::high_res_timer_type start =
+                gruel::high_res_timer_now();
+            demodulate(demod, audio);
+
+            std::ostringstream name;
+            name << (busy ? "busy" : "quiet") << ", "
+                << (thresholds[i] > 0 ? "on" : "off") << " ("
+                << std::setprecision(1) << std::fixed
+                << 100.0 * demod.skipped() / audio.size() << "% skipped)";
+            report(name.str(), seconds_since(start), audio.size());
+        }
+    }
+}
+
+/// The channels that the demodulator types are compared on.
+struct channel
+{
+    const char* name;
+    float noise;
+    float twist;
+};
+
+const channel CHANNELS[] = {
+    {"clean", 0.1F, 1.0F},
+    {"noisy", 0.6F, 1.0F},
+    {"noisy, de-emphasized", 0.6F, 0.5F},
+    {"noisy, pre-emphasized", 0.6F, 2.0F}
+};
+
+const size_t NCHANNELS = sizeof(CHANNELS) / sizeof(CHANNELS[0]);
+
+/**
+ * The delay line discriminator against the correlator, each with the
+ * default Mueller & Muller clock recovery, on 48 kHz audio.
+ */
+void bench_types(const test::bit_vector& bits, size_t sent,
+    test::random_source& random)
+{
+    const int rate = 48000;
+    const int types[] = {
+        afsk1200_demod::DELAY_LINE, afsk1200_demod::CORRELATOR
+    };
+    const char* names[] = {"delay line", "correlator"};
+
+    std::cout << "Demodulator, by type:" << std::endl;
+
+    for (size_t i = 0; i != NCHANNELS; ++i)
+    {
+        const std::vector<float> audio = test::modulate(
+            bits, rate, CHANNELS[i].twist, CHANNELS[i].noise, random);
+
+        for (size_t j = 0; j != 2; ++j)
+        {
+            detail::afsk1200_demodulator demod(rate, 1200, .000448, 0,
+                afsk1200_demod::WORKING_RATE, types[j]);
+            double seconds = 0;
+            const size_t frames = decode(demod, audio, seconds);
+
+            std::ostringstream name;
+            name << names[j] << ", " << CHANNELS[i].name;
+            report(name.str(), seconds, audio.size(), frames, sent);
+        }
+    }
+}
+
+/**
+ * Mueller & Muller clock recovery against the PLL, with each type of
+ * demodulator, on 48 kHz audio.  Packets with only four flags before
+ * them show how quickly each locks.
+ */
+void bench_clocks(test::random_source& random)
+{
+    const int rate = 48000;
+    const int types[] = {
+        afsk1200_demod::DELAY_LINE, afsk1200_demod::CORRELATOR
+    };
+    const char* type_names[] = {"delay line", "correlator"};
+    const int clocks[] = {afsk1200_demod::MUELLER_MULLER, afsk1200_demod::PLL};
+    const char* clock_names[] = {"M&M", "PLL"};
+
+    std::cout << "Clock recovery:" << std::endl;
+
+    const size_t preambles[] = {30, 4};
+    for (size_t i = 0; i != 2; ++i)
+    {
+        size_t sent = 0;
+        const test::bit_vector bits =
+            make_packets(random, sent, preambles[i]);
+        const std::vector<float> audio =
+            test::modulate(bits, rate, 1.0, 0.6, random);
+
+        for (size_t j = 0; j != 2; ++j)
+        {
+            for (size_t k = 0; k != 2; ++k)
+            {
+                detail::afsk1200_demodulator demod(rate, 1200, .000448, 0,
+                    afsk1200_demod::WORKING_RATE, types[j], clocks[k]);
+                double seconds = 0;
+                const size_t frames = decode(demod, audio, seconds);
+
+                std::ostringstream name;
+                name << type_names[j] << ", " << clock_names[k] << ", "
+                    << preambles[i] << " flags";
+                report(name.str(), seconds, audio.size(), frames, sent);
+            }
+        }
+    }
+}
+
+} // namespace
+
+int main()
+{
+    test::random_source random(1);
+    size_t sent = 0;
+    const test::bit_vector bits = make_packets(random, sent);
+
+    bench_filter(test::modulate(
+        bits, afsk1200_demod::WORKING_RATE, 1.0, 0.1, random));
+    bench_rates(bits, random);
+    bench_idle(bits, random);
+    bench_types(bits, sent, random);
+    bench_clocks(random);
+
+    return 0;
+}
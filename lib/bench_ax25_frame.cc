@@ -0,0 +1,162 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+// Times strict_ax25_frame against ax25_frame_view, filtering frames on
+// their addresses and formatting them as text.  Run it by hand, from a
+// Release build:
+//
+//   lib/bench_ax25_frame
+
+#include "ax25_frame_view.h"
+#include "test_signals.h"
+
+#include <gruel/high_res_timer.h>
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+using namespace gr::mobilinkd;
+
+namespace {
+
+const size_t FRAMES = 10000;
+const int PASSES = 50;
+
+double seconds_since(gruel::high_res_timer_type start)
+{
+    return double(gruel::high_res_timer_now() - start)
+        / gruel::high_res_timer_tps();
+}
+
+void report(const std::string& name, double seconds, size_t count,
+    const char* what)
+{
+    std::cout << "  " << std::left << std::setw(32) << name
+        << std::right << std::fixed << std::setprecision(1)
+        << std::setw(8) << seconds * 1e9 / (FRAMES * PASSES) << " ns/frame"
+        << std::setw(10) << count << " " << what << std::endl;
+}
+
+/// Frames from N0CALL to APRS, with up to three WIDE repeaters.
+std::vector<std::string> make_frames(test::random_source& random)
+{
+    std::vector<std::string> frames;
+    for (size_t i = 0; i != FRAMES; ++i)
+    {
+        std::string frame = test::make_frame(20 + random.below(60), random);
+
+        // Insert the repeaters after the source, and move the
+        // extension bit to the last of them.
+        const size_t repeaters = random.below(4);
+        if (repeaters != 0)
+        {
+            std::string path;
+            for (size_t j = 0; j != repeaters; ++j)
+            {
+                const char* call = "WIDE2 ";
+                for (size_t k = 0; k != 6; ++k) path += char(call[k] << 1);
+                path += char(0x60 | (2 << 1) | (j + 1 == repeaters));
+            }
+            frame.erase(frame.size() - 2);
+            frame[13] &= ~1;
+            frame.insert(14, path);
+
+            crc_ccitt crc;
+            crc(frame.data(), frame.size());
+            const uint16_t fcs = ~crc.crc_;
+            frame += char(fcs & 0xFF);
+            frame += char(fcs >> 8);
+        }
+
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+/// Frames to APRS through WIDE2-2, as a digipeater would pick them out.
+void bench_filter(const std::vector<std::string>& frames)
+{
+    const callsign aprs = callsign::from_string("APRS");
+    const callsign wide = callsign::from_string("WIDE2-2");
+
+    size_t matched = 0;
+    gruel::high_res_timer_type start = gruel::high_res_timer_now();
+    for (int pass = 0; pass != PASSES; ++pass)
+    {
+        for (size_t i = 0; i != frames.size(); ++i)
+        {
+            const strict_ax25_frame frame(frames[i]);
+            if (frame.destination() == "APRS" and not frame.repeaters().empty()
+                and frame.repeaters()[0] == "WIDE2-2")
+            {
+                ++matched;
+            }
+        }
+    }
+    report("strict_ax25_frame", seconds_since(start), matched, "matched");
+
+    matched = 0;
+    start = gruel::high_res_timer_now();
+    for (int pass = 0; pass != PASSES; ++pass)
+    {
+        for (size_t i = 0; i != frames.size(); ++i)
+        {
+            const ax25_frame_view frame(frames[i].data(), frames[i].size());
+            if (frame.crc_ok() and frame.destination() == aprs
+                and frame.repeater_count() != 0 and frame.repeater(0) == wide)
+            {
+                ++matched;
+            }
+        }
+    }
+    report("ax25_frame_view", seconds_since(start), matched, "matched");
+}
+
+/// Frames formatted as the framer's text output.
+void bench_text(const std::vector<std::string>& frames)
+{
+    std::ostringstream output;
+    size_t bytes = 0;
+
+    gruel::high_res_timer_type start = gruel::high_res_timer_now();
+    for (int pass = 0; pass != PASSES; ++pass)
+    {
+        for (size_t i = 0; i != frames.size(); ++i)
+        {
+            output.str("");
+            write(output, sloppy_ax25_frame(frames[i]));
+            bytes += output.str().size();
+        }
+    }
+    report("sloppy_ax25_frame", seconds_since(start), bytes, "bytes");
+
+    bytes = 0;
+    start = gruel::high_res_timer_now();
+    for (int pass = 0; pass != PASSES; ++pass)
+    {
+        for (size_t i = 0; i != frames.size(); ++i)
+        {
+            output.str("");
+            write(output, ax25_frame_view(frames[i].data(), frames[i].size()));
+            bytes += output.str().size();
+        }
+    }
+    report("ax25_frame_view", seconds_since(start), bytes, "bytes");
+}
+
+} // namespace
+
+int main()
+{
+    test::random_source random(1);
+    const std::vector<std::string> frames = make_frames(random);
+
+    std::cout << "Filter on destination and first repeater:" << std::endl;
+    bench_filter(frames);
+
+    std::cout << "Format as text:" << std::endl;
+    bench_text(frames);
+
+    return 0;
+}
@@ -0,0 +1,139 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+// Times hdlc_state_machine on bits that are all noise and on back to
+// back frames, pushed one bit at a time, eight at a time and 64 at a
+// time.  Run it by hand, from a Release build:
+//
+//   lib/bench_hdlc_framer
+
+#include "hdlc_framer_impl.h"
+#include "test_signals.h"
+
+#include <gruel/high_res_timer.h>
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+using namespace gr::mobilinkd;
+using detail::hdlc_state_machine;
+
+namespace {
+
+const size_t BITS = 80000000;
+
+double seconds_since(gruel::high_res_timer_type start)
+{
+    return double(gruel::high_res_timer_now() - start)
+        / gruel::high_res_timer_tps();
+}
+
+void report(const std::string& name, double seconds, size_t bits,
+    size_t frames)
+{
+    std::cout << "  " << std::left << std::setw(24) << name
+        << std::right << std::fixed << std::setprecision(2)
+        << std::setw(8) << seconds * 1e9 / bits << " ns/bit"
+        << std::setw(10) << frames << " frames" << std::endl;
+}
+
+void bench_bits(const std::vector<uint8_t>& bytes)
+{
+    hdlc_state_machine machine(false);
+    size_t frames = 0;
+
+    const gruel::high_res_timer_type start = gruel::high_res_timer_now();
+    for (size_t i = 0; i != bytes.size(); ++i)
+    {
+        for (int j = 0; j != 8; ++j)
+        {
+            if (machine((bytes[i] >> j) & 1))
+            {
+                machine.clear_frame();
+                ++frames;
+            }
+        }
+    }
+    report("operator()", seconds_since(start), bytes.size() * 8, frames);
+}
+
+void bench_bytes(const std::vector<uint8_t>& bytes)
+{
+    hdlc_state_machine machine(false);
+    size_t frames = 0;
+
+    const gruel::high_res_timer_type start = gruel::high_res_timer_now();
+    for (size_t i = 0; i != bytes.size(); ++i)
+    {
+        if (machine.push_byte(bytes[i]))
+        {
+            machine.clear_frame();
+            ++frames;
+        }
+    }
+    report("push_byte()", seconds_since(start), bytes.size() * 8, frames);
+}
+
+/// push_word() where it takes the bits, as hdlc_framer does with packed
+/// input, and push_byte() for the rest.
+void bench_words(const std::vector<uint8_t>& bytes)
+{
+    hdlc_state_machine machine(false);
+    size_t frames = 0;
+
+    const gruel::high_res_timer_type start = gruel::high_res_timer_now();
+    size_t i = 0;
+    while (i != bytes.size())
+    {
+        const size_t end = std::min(bytes.size(), i + 8);
+
+        if (end - i == 8)
+        {
+            uint64_t word = 0;
+            for (size_t j = 8; j-- != 0; ) word = (word << 8) | bytes[i + j];
+            i += machine.push_word(word);
+        }
+
+        for (; i != end; ++i)
+        {
+            if (machine.push_byte(bytes[i]))
+            {
+                machine.clear_frame();
+                ++frames;
+            }
+        }
+    }
+    report("push_word()", seconds_since(start), bytes.size() * 8, frames);
+}
+
+void bench(const std::string& name, const test::bit_vector& bits)
+{
+    const std::vector<uint8_t> bytes = test::pack(bits);
+
+    std::cout << name << ":" << std::endl;
+    bench_bits(bytes);
+    bench_bytes(bytes);
+    bench_words(bytes);
+}
+
+} // namespace
+
+int main()
+{
+    test::random_source random(1);
+
+    test::bit_vector noise;
+    test::append_noise(noise, BITS, random);
+    bench("Noise", noise);
+
+    test::bit_vector frames;
+    while (frames.size() < BITS)
+    {
+        test::append_flags(frames, 3);
+        test::append_frame(frames, test::make_frame(200, random));
+    }
+    bench("Back to back 218 byte frames", frames);
+
+    return 0;
+}
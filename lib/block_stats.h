@@ -0,0 +1,72 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#ifndef GR__MOBILINKD__BLOCK_STATS_H_
+#define GR__MOBILINKD__BLOCK_STATS_H_
+
+#include <gruel/high_res_timer.h>
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <stdint.h>
+#include <cstddef>
+
+namespace gr { namespace mobilinkd { namespace detail {
+
+/**
+ * N counters kept by a block's work() function and read by get_stats()
+ * from another thread.  Only work() writes them, once per call, so the
+ * atomics need no ordering and are updated relaxed.  They are padded
+ * on both sides to a cache line, so that work() does not fight the
+ * reader over the block's other members.
+ */
+template <size_t N>
+class block_stats : boost::noncopyable
+{
+public:
+
+    static const size_t CACHE_LINE = 64;
+
+    block_stats()
+    {
+        for (size_t i = 0; i != N; ++i) values_[i].store(0);
+    }
+
+    void add(size_t i, uint64_t n)
+    {
+        values_[i].fetch_add(n, boost::memory_order_relaxed);
+    }
+
+    /// Raise counter @p i to @p n if it is lower.  Only work() may call it.
+    void raise(size_t i, uint64_t n)
+    {
+        if (n > values_[i].load(boost::memory_order_relaxed))
+        {
+            values_[i].store(n, boost::memory_order_relaxed);
+        }
+    }
+
+    uint64_t get(size_t i) const
+    {
+        return values_[i].load(boost::memory_order_relaxed);
+    }
+
+private:
+
+    char before_[CACHE_LINE];
+    boost::atomic<uint64_t> values_[N];
+    char after_[CACHE_LINE];
+};
+
+/// The nanoseconds since @p start, a gruel::high_res_timer_now() time.
+inline uint64_t ns_since(gruel::high_res_timer_type start)
+{
+    const gruel::high_res_timer_type ticks =
+        gruel::high_res_timer_now() - start;
+    return uint64_t(double(ticks) * 1e9 / gruel::high_res_timer_tps());
+}
+
+}}} // gr::mobilinkd::detail
+
+#endif // GR__MOBILINKD__BLOCK_STATS_H_
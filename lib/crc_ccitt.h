@@ -0,0 +1,106 @@
+// Copyright 2012 Robert C. Riggs <rob@pangalactic.org>
+// All rights reserved.
+
+#ifndef GR__MOBILINKD__CRC_CCITT_H_
+#define GR__MOBILINKD__CRC_CCITT_H_
+
+#include <stdint.h>
+#include <cstddef>
+
+namespace gr { namespace mobilinkd {
+
+/**
+ * Table driven CRC-CCITT, as used for the AX.25 frame check sequence.
+ * Bytes are added one at a time as they are received, LSB first.
+ *
+ * Running the CRC over a frame including its FCS leaves GOOD_CRC in
+ * the register when the FCS is correct, so a frame can be checked as
+ * soon as its closing flag arrives.  The register from two bytes back
+ * (before the FCS) is kept so that the computed CRC is also available.
+ */
+struct crc_ccitt
+{
+    static const uint16_t POLY = 0x8408;    // 0x1021 reflected.
+    static const uint16_t GOOD_CRC = 0xF0B8;
+
+    uint16_t crc_;
+    uint16_t previous_[2];
+
+    crc_ccitt()
+    {
+        reset();
+    }
+
+    static const uint16_t* table()
+    {
+        static const table_type instance;
+        return instance.table_;
+    }
+
+    /// Reverse the order of the bits in @p x.
+    static uint16_t reverse(uint16_t x)
+    {
+        x = ((x >> 1) & 0x5555) | ((x & 0x5555) << 1);
+        x = ((x >> 2) & 0x3333) | ((x & 0x3333) << 2);
+        x = ((x >> 4) & 0x0F0F) | ((x & 0x0F0F) << 4);
+        x = (x >> 8) | (x << 8);
+        return x;
+    }
+
+    void reset()
+    {
+        crc_ = 0xFFFF;
+        previous_[0] = previous_[1] = 0xFFFF;
+    }
+
+    void operator()(uint8_t c)
+    {
+        previous_[1] = previous_[0];
+        previous_[0] = crc_;
+        crc_ = (crc_ >> 8) ^ table()[(crc_ ^ c) & 0xFF];
+    }
+
+    void operator()(const char* data, size_t size)
+    {
+        for (size_t i = 0; i != size; ++i) (*this)(uint8_t(data[i]));
+    }
+
+    /// True if the bytes added so far end with a valid FCS.
+    bool good() const
+    {
+        return crc_ == GOOD_CRC;
+    }
+
+    /**
+     * The CRC of all but the last two bytes added, bit reversed to
+     * match ax25_frame::fcs().
+     */
+    uint16_t checksum() const
+    {
+        return reverse(~previous_[1]);
+    }
+
+private:
+
+    struct table_type
+    {
+        uint16_t table_[256];
+
+        table_type()
+        {
+            for (int i = 0; i != 256; ++i)
+            {
+                uint16_t crc = i;
+                for (int j = 0; j != 8; ++j)
+                {
+                    crc = (crc & 1) ? ((crc >> 1) ^ POLY) : (crc >> 1);
+                }
+                table_[i] = crc;
+            }
+        }
+    };
+};
+
+}} // gr::mobilinkd
+
+#endif // GR__MOBILINKD__CRC_CCITT_H_
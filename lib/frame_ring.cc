@@ -0,0 +1,187 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#include "frame_ring.h"
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+namespace gr { namespace mobilinkd {
+
+namespace {
+
+/**
+ * head_ is only advanced by the producer, after it fills a slot.  tail_
+ * is advanced by the consumer as it claims a slot to read and, under
+ * DROP_OLDEST, by the producer as it discards a frame; both use
+ * compare and swap, so each frame is either read or dropped, not both.
+ *
+ * A consumer that claimed a slot may still be copying it when the
+ * producer laps the ring under DROP_OLDEST.  There is one slot more
+ * than the capacity, so that can only happen to the slot the producer
+ * is about to fill, and reading_ tells it so.  The producer then drops
+ * the new frame rather than overwrite the one being read.
+ */
+class spsc_frame_ring : public frame_ring
+{
+public:
+
+    spsc_frame_ring(size_t capacity, int policy)
+    : capacity_(capacity), policy_(policy), slots_(capacity + 1)
+    , head_(0), tail_(0), reading_(NONE), dropped_(0)
+    {
+        if (capacity == 0)
+        {
+            throw std::invalid_argument("frame_ring: capacity must be > 0");
+        }
+
+        if (policy < DROP_OLDEST or policy > BLOCK)
+        {
+            throw std::invalid_argument("frame_ring: unknown policy");
+        }
+    }
+
+    virtual bool push(
+        const char* data, size_t size, bool crc_ok, uint64_t offset)
+    {
+        const uint64_t head = head_.load(boost::memory_order_relaxed);
+
+        uint64_t tail = tail_.load();
+        while (head - tail == capacity_)
+        {
+            switch (policy_)
+            {
+            case DROP_OLDEST:
+                if (tail_.compare_exchange_weak(tail, tail + 1))
+                {
+                    dropped_.fetch_add(1, boost::memory_order_relaxed);
+                    tail += 1;
+                }
+                break;
+            case BLOCK:
+                boost::this_thread::sleep(
+                    boost::posix_time::milliseconds(POLL_INTERVAL_MS));
+                tail = tail_.load();
+                break;
+            default:
+                dropped_.fetch_add(1, boost::memory_order_relaxed);
+                return false;
+            }
+        }
+
+        const uint64_t lapped = head - slots_.size();
+        if (head >= slots_.size() and reading_.load() == lapped)
+        {
+            dropped_.fetch_add(1, boost::memory_order_relaxed);
+            return false;
+        }
+
+        slot& s = slots_[head % slots_.size()];
+        s.size = std::min(size, MAX_SIZE);
+        s.crc_ok = crc_ok;
+        s.offset = offset;
+        std::memcpy(s.data, data, s.size);
+
+        head_.store(head + 1, boost::memory_order_release);
+        return true;
+    }
+
+    virtual bool pop(ring_frame& frame)
+    {
+        uint64_t tail = tail_.load();
+
+        while (tail != head_.load(boost::memory_order_acquire))
+        {
+            reading_.store(tail);
+            if (tail_.compare_exchange_strong(tail, tail + 1))
+            {
+                const slot& s = slots_[tail % slots_.size()];
+                frame.data.assign(s.data, s.size);
+                frame.crc_ok = s.crc_ok;
+                frame.offset = s.offset;
+
+                reading_.store(NONE);
+                return true;
+            }
+            // The frame was dropped; tail now holds the next one.
+        }
+
+        reading_.store(NONE);
+        return false;
+    }
+
+    virtual bool wait(ring_frame& frame, double timeout)
+    {
+        const boost::posix_time::ptime deadline =
+            boost::posix_time::microsec_clock::universal_time()
+            + boost::posix_time::microseconds(int64_t(timeout * 1e6));
+
+        while (not pop(frame))
+        {
+            if (boost::posix_time::microsec_clock::universal_time()
+                >= deadline)
+            {
+                return false;
+            }
+
+            boost::this_thread::sleep(
+                boost::posix_time::milliseconds(POLL_INTERVAL_MS));
+        }
+
+        return true;
+    }
+
+    virtual size_t size() const
+    {
+        const uint64_t tail = tail_.load();
+        return size_t(head_.load() - tail);
+    }
+
+    virtual size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    virtual unsigned long dropped() const
+    {
+        return dropped_.load(boost::memory_order_relaxed);
+    }
+
+private:
+
+    static const int POLL_INTERVAL_MS = 1;
+    static const uint64_t NONE = ~uint64_t(0);
+
+    struct slot
+    {
+        size_t size;
+        bool crc_ok;
+        uint64_t offset;
+        char data[MAX_SIZE];
+    };
+
+    const size_t capacity_;
+    const int policy_;
+    std::vector<slot> slots_;
+    boost::atomic<uint64_t> head_;      ///< Frames pushed.
+    boost::atomic<uint64_t> tail_;      ///< Frames read or dropped.
+    boost::atomic<uint64_t> reading_;   ///< The frame being read, or NONE.
+    boost::atomic<unsigned long> dropped_;
+};
+
+} // namespace
+
+const size_t frame_ring::MAX_SIZE;
+
+frame_ring::sptr frame_ring::make(size_t capacity, int policy)
+{
+    return sptr(new spsc_frame_ring(capacity, policy));
+}
+
+}} // gr::mobilinkd
@@ -7,43 +7,323 @@
 
 #include <gnuradio/gr_io_signature.h>
 
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
 namespace gr { namespace mobilinkd {
 
 
-hdlc_framer::sptr hdlc_framer::make(bool pass_all)
+hdlc_framer::sptr hdlc_framer::make(bool pass_all, gr_msg_queue_sptr msgq,
+    int output, int channel, int max_flips, bool packed)
 {
-    return hdlc_framer_impl::make(pass_all);
+    return hdlc_framer_impl::make(
+        pass_all, msgq, output, channel, max_flips, packed);
 }
 
-hdlc_framer::sptr hdlc_framer::make(bool pass_all, gr_msg_queue_sptr msgq)
+
+namespace detail {
+
+namespace {
+
+/// Orders data bits by their confidence, lowest first.
+struct less_confident
+{
+    const std::vector<uint8_t>& confidence_;
+
+    less_confident(const std::vector<uint8_t>& confidence)
+    : confidence_(confidence)
+    {}
+
+    bool operator()(size_t a, size_t b) const
+    {
+        return confidence_[a] < confidence_[b];
+    }
+};
+
+} // anonymous
+
+soft_bit_repair::soft_bit_repair(int max_flips)
+: max_flips_(std::max(0, std::min(max_flips, int(MAX_FLIPS))))
+, history_(HISTORY, 0), count_(0), repaired_(0)
+, bits_(), confidence_(), stuffed_(), syndrome_(), candidates_()
+, ncandidates_(0)
+{}
+
+bool soft_bit_repair::flag_ends_at(uint64_t i) const
 {
-    return hdlc_framer_impl::make(pass_all, msgq);
+    // A flag reads the same in either direction.
+    uint8_t bits = 0;
+    for (int j = 0; j != 8; ++j) bits |= (bit(i - j) << j);
+    return bits == 0x7E;
 }
 
-hdlc_framer_impl::hdlc_framer_impl(bool pass_all)
-: gr_sync_block("hdlc_framer",
-    gr_make_io_signature(1, 1, 1),
-    gr_make_io_signature(0, 0, 0))
-, msgq_(gr_make_msg_queue()), state_(pass_all)
+bool soft_bit_repair::repair(frame_buffer& frame)
 {
-    std::clog << "Starting HDLC Framer" << std::endl;
-    gr_message_sptr msg =
-        gr_make_message_from_string("Starting HDLC Framer\n", 0, 0, 0);
+    const uint64_t nbits = frame.size() * 8;
+    const uint64_t longest = nbits + nbits / 5;   // With stuffed zeros.
 
-    msgq_->insert_tail(msg);         // send it
+    // Both flags and the frame between them must still be in the history.
+    if (max_flips_ == 0 or longest + 24 > std::min<uint64_t>(count_, HISTORY))
+    {
+        return false;
+    }
+
+    // The first flag to end in the last eight bits closed the frame.
+    uint64_t end = count_ - 8;
+    while (end != count_ and not flag_ends_at(end)) ++end;
+    if (end == count_) return false;
+
+    // Stuffing keeps flags out of the frame, so the nearest flag before
+    // it opened the frame.
+    const uint64_t stop = end - 7;
+    for (uint64_t start = stop - nbits; start >= stop - longest; --start)
+    {
+        if (not flag_ends_at(start - 1)) continue;
+
+        return unstuff(start, stop, frame) and search(frame);
+    }
+
+    return false;
+}
+
+bool soft_bit_repair::unstuff(
+    uint64_t begin, uint64_t end, const frame_buffer& frame)
+{
+    bits_.clear();
+    confidence_.clear();
+    stuffed_.clear();
+
+    int ones = 0;
+    for (uint64_t i = begin; i != end; ++i)
+    {
+        const int8_t soft = history_[i & (HISTORY - 1)];
+        const int b = soft > 0;
+
+        if (ones == 5)
+        {
+            if (b) return false;
+            stuffed_.back() = 1;
+            ones = 0;
+            continue;
+        }
+
+        ones = b ? ones + 1 : 0;
+        bits_.push_back(b);
+        confidence_.push_back(uint8_t(std::abs(int(soft))));
+        stuffed_.push_back(0);
+    }
+
+    if (bits_.size() != frame.size() * 8) return false;
+
+    // These must be the bits that the state machine framed.
+    for (size_t i = 0; i != frame.size(); ++i)
+    {
+        uint8_t c = 0;
+        for (int j = 0; j != 8; ++j) c |= (bits_[i * 8 + j] << j);
+        if (c != uint8_t(frame[i])) return false;
+    }
+
+    return true;
+}
+
+bool soft_bit_repair::search(frame_buffer& frame)
+{
+    const size_t n = bits_.size();
+
+    crc_ccitt crc;
+    crc(frame.data(), frame.size());
+    const uint16_t error = crc.crc_ ^ crc_ccitt::GOOD_CRC;
+
+    // Flipping the last bit changes the register by POLY.  A flip in an
+    // earlier bit is carried on through the rest as if they were zeros.
+    syndrome_.resize(n);
+    uint16_t syndrome = crc_ccitt::POLY;
+    for (size_t k = n; k-- != 0; )
+    {
+        syndrome_[k] = syndrome;
+        syndrome = (syndrome & 1)
+            ? (syndrome >> 1) ^ crc_ccitt::POLY : (syndrome >> 1);
+    }
+
+    candidates_.resize(n);
+    for (size_t k = 0; k != n; ++k) candidates_[k] = k;
+
+    ncandidates_ = std::min(n, size_t(CANDIDATES));
+    std::partial_sort(candidates_.begin(),
+        candidates_.begin() + ncandidates_, candidates_.end(),
+        less_confident(confidence_));
+
+    // Fewer flips are more likely, so they are tried first.
+    for (int nflips = 1; nflips <= max_flips_; ++nflips)
+    {
+        if (combine(0, 0, nflips, error, frame))
+        {
+            ++repaired_;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool soft_bit_repair::combine(size_t first, int depth, int nflips,
+    uint16_t error, frame_buffer& frame)
+{
+    if (depth == nflips)
+    {
+        return error == 0 and apply(nflips, frame);
+    }
+
+    for (size_t i = first; i != ncandidates_; ++i)
+    {
+        flips_[depth] = candidates_[i];
+        if (combine(i + 1, depth + 1, nflips,
+            error ^ syndrome_[candidates_[i]], frame))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool soft_bit_repair::apply(int nflips, frame_buffer& frame)
+{
+    for (int i = 0; i != nflips; ++i) bits_[flips_[i]] ^= 1;
+
+    // The zeros must be stuffed in the same places as before.
+    bool valid = true;
+    int ones = 0;
+    for (size_t k = 0; valid and k != bits_.size(); ++k)
+    {
+        ones = bits_[k] ? ones + 1 : 0;
+        valid = ((ones == 5) == bool(stuffed_[k]));
+        if (ones == 5) ones = 0;
+    }
+
+    if (valid)
+    {
+        char repaired[frame_buffer::CAPACITY];
+        for (size_t i = 0; i != frame.size(); ++i)
+        {
+            uint8_t c = 0;
+            for (int j = 0; j != 8; ++j) c |= (bits_[i * 8 + j] << j);
+            repaired[i] = c;
+        }
+
+        crc_ccitt crc;
+        crc(repaired, frame.size());
+        if (crc.good())
+        {
+            const size_t size = frame.size();
+            frame.clear();
+            frame.append(repaired, size);
+            return true;
+        }
+    }
+
+    for (int i = 0; i != nflips; ++i) bits_[flips_[i]] ^= 1;
+    return false;
+}
+
+bool report_history::summarize(
+    uint64_t start, uint64_t end, frame_quality& quality) const
+{
+    const demod_report* first = 0;
+    const demod_report* last = 0;
+    size_t count = 0;
+    size_t tones = 0;
+
+    quality.level = quality.timing_error = quality.twist = 0;
+
+    for (size_t i = 0; i != size_; ++i)
+    {
+        const demod_report& report = reports_[i];
+        if (report.bit < start or report.bit > end) continue;
+
+        if (not first or report.bit < first->bit) first = &report;
+        if (not last or report.bit > last->bit) last = &report;
+
+        quality.timing_error += report.timing_error;
+        ++count;
+
+        if (report.tones)
+        {
+            quality.level += report.level;
+            quality.twist += report.twist;
+            ++tones;
+        }
+    }
+
+    if (count == 0) return false;
+
+    quality.timing_error /= count;
+    quality.tones = tones != 0;
+    if (quality.tones)
+    {
+        quality.level /= tones;
+        quality.twist /= tones;
+    }
+
+    quality.located = last->bit != first->bit;
+    if (quality.located)
+    {
+        const double rate = (double(last->sample) - double(first->sample))
+            / double(last->bit - first->bit);
+        quality.start_sample = uint64_t(std::max(0.0, std::floor(
+            first->sample - (first->bit - start) * rate + 0.5)));
+        quality.end_sample = uint64_t(std::floor(
+            last->sample + (end - last->bit) * rate + 0.5));
+    }
+
+    return true;
 }
 
-hdlc_framer_impl::hdlc_framer_impl(bool pass_all, gr_msg_queue_sptr msgq)
+} // detail
+
+
+hdlc_framer_impl::hdlc_framer_impl(bool pass_all, gr_msg_queue_sptr msgq,
+    int output, int channel, int max_flips, bool packed)
 : gr_sync_block("hdlc_framer",
     gr_make_io_signature(1, 1, 1),
     gr_make_io_signature(0, 0, 0))
-, msgq_(msgq), state_(pass_all)
+, msgq_(msgq), ring_(), state_(pass_all), repair_(max_flips)
+, packed_(packed), pending_bits_(0), pending_count_(0)
+, output_(output), channel_(channel)
+, pdu_port_(pmt::pmt_intern("pdus"))
+, crc_ok_key_(pmt::pmt_intern("crc_ok"))
+, offset_key_(pmt::pmt_intern("offset"))
+, channel_key_(pmt::pmt_intern("channel"))
+, start_key_(pmt::pmt_intern("start"))
+, destination_key_(pmt::pmt_intern("destination"))
+, source_key_(pmt::pmt_intern("source"))
+, start_sample_key_(pmt::pmt_intern("start_sample"))
+, end_sample_key_(pmt::pmt_intern("end_sample"))
+, level_key_(pmt::pmt_intern("level"))
+, timing_error_key_(pmt::pmt_intern("timing_error"))
+, twist_key_(pmt::pmt_intern("twist"))
+, quality_key_(pmt::pmt_intern("afsk_quality"))
+, sample_key_(pmt::pmt_intern("sample"))
+, tags_(), reports_(), stats_(), repaired_(0)
 {
-    std::clog << "Starting HDLC Framer" << std::endl;
-    gr_message_sptr msg =
-        gr_make_message_from_string("Starting HDLC Framer\n", 0, 0, 0);
+    if (packed and max_flips > 0)
+    {
+        throw std::invalid_argument(
+            "hdlc_framer: packed bits cannot be repaired");
+    }
 
-    msgq_->insert_tail(msg);         // send it
+    if (max_flips > 0) state_.repair_ = &repair_;
+
+    message_port_register_out(pdu_port_);
+
+    if (output_ & TEXT_OUTPUT)
+    {
+        gr_message_sptr msg =
+            gr_make_message_from_string("Starting HDLC Framer\n", 0, 0, 0);
+
+        msgq_->insert_tail(msg);         // send it
+    }
 }
 
 int hdlc_framer_impl::work(
@@ -51,30 +331,227 @@ int hdlc_framer_impl::work(
     gr_vector_const_void_star& input_items,
     gr_vector_void_star& output_items)
 {
-    const unsigned char* source =
-        reinterpret_cast<const unsigned char*>(input_items[0]);
+    const gruel::high_res_timer_type start = gruel::high_res_timer_now();
+    const int8_t* source = reinterpret_cast<const int8_t*>(input_items[0]);
 
-    for (int i = 0; i != size; ++i)
+    if (output_ & PDU_OUTPUT) read_reports(size);
+
+    // Packed bits are handed straight to the state machine, 64 at a
+    // time where it can take them.  The offset is that of the last bit
+    // in the byte.
+    if (packed_)
     {
-        state_(source[i]);
-        if (state_.ready())
+        int i = 0;
+        while (i != size)
         {
-            try
+            const int end = std::min(size, i + 8);
+
+            if (end - i == 8)
             {
-                sloppy_ax25_frame frame(state_.frame());
-                std::ostringstream output;
-                write(output, frame);
-                gr_message_sptr msg =
-                    gr_make_message_from_string(output.str());
+                uint64_t word = 0;
+                for (int j = 8; j-- != 0; )
+                {
+                    word = (word << 8) | uint8_t(source[i + j]);
+                }
+                i += state_.push_word(word);
+            }
 
-                msgq_->insert_tail(msg);         // send it
+            for (; i != end; ++i)
+            {
+                if (state_.push_byte(uint8_t(source[i])))
+                {
+                    send_frame((nitems_read(0) + i) * 8 + 7);
+                }
             }
-            catch (bad_frame&)
-            {}
         }
+
+        update_stats(uint64_t(size) * 8, start);
+        return size;
+    }
+
+    // Bits are handed to the state machine eight at a time.  Any left
+    // over are kept until the next call.  Hard bits are 0 or 1; soft
+    // bits are positive for a 1, and are kept for repairing frames.
+    for (int i = 0; i != size; ++i)
+    {
+        if (state_.repair_) repair_(source[i]);
+
+        pending_bits_ |= ((source[i] > 0) << pending_count_);
+        if (++pending_count_ != 8) continue;
+
+        if (state_.push_byte(pending_bits_))
+        {
+            send_frame(nitems_read(0) + i);
+        }
+
+        pending_bits_ = 0;
+        pending_count_ = 0;
     }
 
+    update_stats(size, start);
     return size;
 }
 
+void hdlc_framer_impl::update_stats(
+    uint64_t bits, gruel::high_res_timer_type start)
+{
+    const detail::hdlc_state_machine::counts& counts = state_.counts_;
+
+    stats_.add(BITS_IN, bits);
+    stats_.add(FLAGS, counts.flags);
+    stats_.add(FRAMES_ATTEMPTED, counts.frames);
+    stats_.add(FRAMES_OK, counts.good);
+    stats_.add(CRC_FAILURES, counts.bad);
+    stats_.add(TOO_SHORT, counts.too_short);
+    stats_.add(TOO_LONG, counts.too_long);
+    stats_.add(STUFF_ERRORS, counts.stuff_errors);
+    stats_.add(TIMEOUTS, counts.timeouts);
+    state_.counts_.clear();
+
+    stats_.add(FRAMES_REPAIRED, repair_.repaired_ - repaired_);
+    repaired_ = repair_.repaired_;
+
+    const uint64_t ns = detail::ns_since(start);
+    stats_.add(WORK_CALLS, 1);
+    stats_.add(WORK_NS, ns);
+    stats_.raise(MAX_WORK_NS, ns);
+}
+
+hdlc_framer_stats hdlc_framer_impl::get_stats() const
+{
+    hdlc_framer_stats result;
+    result.bits_in = stats_.get(BITS_IN);
+    result.flags = stats_.get(FLAGS);
+    result.frames_attempted = stats_.get(FRAMES_ATTEMPTED);
+    result.frames_ok = stats_.get(FRAMES_OK);
+    result.crc_failures = stats_.get(CRC_FAILURES);
+    result.too_short = stats_.get(TOO_SHORT);
+    result.too_long = stats_.get(TOO_LONG);
+    result.stuff_errors = stats_.get(STUFF_ERRORS);
+    result.timeouts = stats_.get(TIMEOUTS);
+    result.frames_repaired = stats_.get(FRAMES_REPAIRED);
+    result.work_calls = stats_.get(WORK_CALLS);
+    result.work_ns = stats_.get(WORK_NS);
+    result.max_work_ns = stats_.get(MAX_WORK_NS);
+    return result;
+}
+
+void hdlc_framer_impl::read_reports(int size)
+{
+    const uint64_t first = nitems_read(0);
+    const int bits = packed_ ? 8 : 1;
+
+    tags_.clear();
+    get_tags_in_range(tags_, 0, first, first + size, quality_key_);
+
+    for (size_t i = 0; i != tags_.size(); ++i)
+    {
+        const pmt::pmt_t& value = tags_[i].value;
+        if (not pmt::pmt_is_dict(value)
+            or not pmt::pmt_dict_has_key(value, sample_key_))
+        {
+            continue;
+        }
+
+        detail::demod_report report;
+        report.bit = tags_[i].offset * bits;
+        report.sample = pmt::pmt_to_uint64(
+            pmt::pmt_dict_ref(value, sample_key_, pmt::PMT_NIL));
+        report.timing_error = pmt::pmt_to_double(pmt::pmt_dict_ref(
+            value, timing_error_key_, pmt::pmt_from_double(0)));
+        report.tones = pmt::pmt_dict_has_key(value, level_key_);
+        report.level = report.tones ? pmt::pmt_to_double(
+            pmt::pmt_dict_ref(value, level_key_, pmt::PMT_NIL)) : 0;
+        report.twist = report.tones ? pmt::pmt_to_double(
+            pmt::pmt_dict_ref(value, twist_key_, pmt::PMT_NIL)) : 0;
+
+        reports_.add(report);
+    }
+}
+
+void hdlc_framer_impl::send_frame(uint64_t offset)
+{
+    const detail::frame_buffer& frame = state_.frame_data();
+
+    // The frame was closed a few bits before the last one pushed.
+    const uint64_t end = offset - state_.bits_since_frame();
+    const uint64_t start = end + 1 - state_.frame_bits();
+
+    if (output_ & PDU_OUTPUT)
+    {
+        send_pdu(frame, start, end);
+    }
+
+    if (output_ & TEXT_OUTPUT)
+    {
+        send_text(frame);
+    }
+
+    const frame_ring::sptr ring = boost::atomic_load(&ring_);
+    if (ring)
+    {
+        ring->push(frame.data(), frame.size(), state_.crc_ok(), end);
+    }
+
+    state_.clear_frame();
+}
+
+// The frame is read in place, but the text and PDU outputs still build a
+// message for each frame, which allocates; the ring is the output that
+// does not.
+void hdlc_framer_impl::send_text(const detail::frame_buffer& data)
+{
+    ax25_frame_view frame(data.data(), data.size(), state_.checksum());
+    std::ostringstream output;
+    write(output, frame);
+    gr_message_sptr msg = gr_make_message_from_string(output.str());
+
+    msgq_->insert_tail(msg);         // send it
+}
+
+void hdlc_framer_impl::send_pdu(
+    const detail::frame_buffer& data, uint64_t start, uint64_t end)
+{
+    pmt::pmt_t meta = pmt::pmt_make_dict();
+    meta = pmt::pmt_dict_add(meta, crc_ok_key_,
+        pmt::pmt_from_bool(state_.crc_ok()));
+    meta = pmt::pmt_dict_add(meta, offset_key_,
+        pmt::pmt_from_uint64(end));
+    meta = pmt::pmt_dict_add(meta, channel_key_,
+        pmt::pmt_from_long(channel_));
+    meta = pmt::pmt_dict_add(meta, start_key_,
+        pmt::pmt_from_uint64(start));
+    meta = detail::add_addresses(meta,
+        ax25_frame_view(data.data(), data.size(), state_.checksum()),
+        destination_key_, source_key_);
+
+    detail::frame_quality quality;
+    if (reports_.summarize(start, end, quality))
+    {
+        meta = pmt::pmt_dict_add(meta, timing_error_key_,
+            pmt::pmt_from_double(quality.timing_error));
+
+        if (quality.located)
+        {
+            meta = pmt::pmt_dict_add(meta, start_sample_key_,
+                pmt::pmt_from_uint64(quality.start_sample));
+            meta = pmt::pmt_dict_add(meta, end_sample_key_,
+                pmt::pmt_from_uint64(quality.end_sample));
+        }
+
+        if (quality.tones)
+        {
+            meta = pmt::pmt_dict_add(meta, level_key_,
+                pmt::pmt_from_double(quality.level));
+            meta = pmt::pmt_dict_add(meta, twist_key_,
+                pmt::pmt_from_double(quality.twist));
+        }
+    }
+
+    pmt::pmt_t bytes = pmt::pmt_init_u8vector(
+        data.size(), reinterpret_cast<const uint8_t*>(data.data()));
+
+    message_port_pub(pdu_port_, pmt::pmt_cons(meta, bytes));
+}
+
 }} // gr::mobilinkd
@@ -5,27 +5,342 @@
 #define GR__MOBILINKD__HDLC_FRAMER_IMPL_H_
 
 #include "hdlc_framer.h"
-#include "ax25_frame.h"
+#include "log_sink.h"
+#include "frame_size.h"
+#include "ax25_frame_view.h"
+#include "crc_ccitt.h"
+#include "block_stats.h"
 
-#include <boost/scoped_ptr.hpp>
-#include <boost/asio/io_service.hpp>
-#include <boost/asio/deadline_timer.hpp>
-#include <boost/date_time/posix_time/posix_time.hpp>
-#include <boost/bind.hpp>
-#include <boost/thread.hpp>
+#include <gruel/pmt.h>
 
 #include <string>
 #include <vector>
-#include <iostream>
 #include <sstream>
 #include <iomanip>
 #include <iterator>
 #include <algorithm>
+#include <cstring>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
 
 namespace gr { namespace mobilinkd {
 
 namespace detail {
 
+/**
+ * Lookup tables used by hdlc_state_machine to process the bit stream
+ * eight bits at a time.  Bits are taken LSB first.
+ *
+ * - ones_run gives the number of consecutive ones at the top of the
+ *   flag buffer, capped at 6.
+ * - search_flag tells whether a flag is seen anywhere in the next
+ *   eight bits, given the ones_run of the flag buffer.
+ * - unstuff gives, for the ones count and the next eight bits of the
+ *   frame, the data bits left once the stuffed zeros are removed, where
+ *   the zeros were, and the position of any sixth one (an abort or a
+ *   misaligned flag).
+ */
+struct hdlc_tables
+{
+    static const uint8_t NO_ERROR = 8;
+
+    struct unstuff_entry
+    {
+        uint8_t bits;       ///< Data bits, LSB first.
+        uint8_t count;      ///< Number of data bits.
+        uint8_t ones;       ///< Consecutive ones at the end.
+        uint8_t error;      ///< Position of the sixth one, or NO_ERROR.
+        uint8_t stuffed;    ///< Bit k is set for a zero after k data bits.
+        uint32_t position;  ///< Input position of each data bit, 3 bits each.
+    };
+
+    uint8_t ones_run[256];
+    bool search_flag[7][256];
+    unstuff_entry unstuff[6][256];
+
+    static const hdlc_tables& instance()
+    {
+        static const hdlc_tables tables;
+        return tables;
+    }
+
+private:
+
+    hdlc_tables()
+    {
+        for (int i = 0; i != 256; ++i)
+        {
+            int ones = 0;
+            while (ones != 6 and (i & (0x80 >> ones))) ++ones;
+            ones_run[i] = ones;
+        }
+
+        for (int run = 0; run != 7; ++run)
+        {
+            for (int i = 0; i != 256; ++i)
+            {
+                int ones = run;
+                search_flag[run][i] = false;
+                for (int j = 0; j != 8; ++j)
+                {
+                    if (ones == 6) search_flag[run][i] = true;
+                    ones = ((i >> j) & 1) ? std::min(ones + 1, 6) : 0;
+                }
+            }
+        }
+
+        for (int count = 0; count != 6; ++count)
+        {
+            for (int i = 0; i != 256; ++i)
+            {
+                unstuff_entry& entry = unstuff[count][i];
+                entry.bits = 0;
+                entry.count = 0;
+                entry.error = NO_ERROR;
+                entry.stuffed = 0;
+                entry.position = 0;
+
+                int ones = count;
+                for (int j = 0; j != 8; ++j)
+                {
+                    const int bit = (i >> j) & 1;
+                    if (ones < 5)
+                    {
+                        ones = bit ? ones + 1 : 0;
+                        entry.bits |= (bit << entry.count);
+                        entry.position |= (j << (3 * entry.count));
+                        entry.count++;
+                    }
+                    else if (bit == 0)
+                    {
+                        ones = 0;   // Stuffed zero.
+                        entry.stuffed |= (1 << entry.count);
+                    }
+                    else
+                    {
+                        entry.error = j;
+                        break;
+                    }
+                }
+                entry.ones = ones;
+            }
+        }
+    }
+};
+
+/**
+ * Word-parallel counterparts of the hdlc_tables, for 64 raw bits at a
+ * time, LSB first.  Each mask has bit i set where the pattern ends at
+ * bit i of the word.  @p prior holds the bits that came before the
+ * word, the most recent in its top bit, so that patterns running
+ * across the boundary are found.
+ */
+struct hdlc_word
+{
+    uint64_t stuffed;   ///< Zeros that follow exactly five ones.
+    uint64_t flags;     ///< Last bit of each 0x7E flag.
+    uint64_t aborts;    ///< Seventh and later ones of a run.
+    uint64_t sixth;     ///< Sixth and later ones of a run.
+
+    hdlc_word(uint64_t bits, uint64_t prior)
+    {
+        // delayed[k] has the bit k places before each bit.
+        uint64_t delayed[8];
+        delayed[0] = bits;
+        for (int k = 1; k != 8; ++k)
+        {
+            delayed[k] = (bits << k) | (prior >> (64 - k));
+        }
+
+        const uint64_t five = delayed[1] & delayed[2] & delayed[3]
+            & delayed[4] & delayed[5];
+
+        stuffed = ~bits & five & ~delayed[6];
+        flags = ~bits & five & delayed[6] & ~delayed[7];
+        aborts = bits & five & delayed[6];
+        sixth = bits & five;
+    }
+
+    /**
+     * Remove the bits of @p bits marked in @p stuffed, moving the rest
+     * down to fill the gaps.  @p count is set to the number left.
+     */
+    static uint64_t unstuff(uint64_t bits, uint64_t stuffed, int& count)
+    {
+        count = 64;
+        for (uint64_t mask = stuffed; mask != 0; mask &= mask - 1) --count;
+
+#ifdef __BMI2__
+        return _pext_u64(bits, ~stuffed);
+#else
+        // Stuffed zeros are rare, so they are taken out one at a time.
+        while (stuffed != 0)
+        {
+            const uint64_t lowest = stuffed & (~stuffed + 1);
+            const uint64_t below = lowest - 1;
+            bits = (bits & below) | ((bits >> 1) & ~below);
+            stuffed = (stuffed ^ lowest) >> 1;
+        }
+        return bits;
+#endif
+    }
+};
+
+/**
+ * The bytes of one frame, held in place so that deframing never
+ * allocates.  Any bytes past CAPACITY are dropped.
+ */
+struct frame_buffer
+{
+    static const size_t CAPACITY = MAX_FRAME_SIZE;
+
+    size_t size_;
+    char data_[CAPACITY];
+
+    frame_buffer() : size_(0) {}
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    char operator[](size_t i) const { return data_[i]; }
+
+    void clear() { size_ = 0; }
+
+    void push_back(char c)
+    {
+        if (size_ != CAPACITY) data_[size_++] = c;
+    }
+
+    void append(const char* data, size_t size)
+    {
+        size = std::min(size, CAPACITY - size_);
+        std::memcpy(data_ + size_, data, size);
+        size_ += size;
+    }
+
+    std::string str() const { return std::string(data_, size_); }
+};
+
+/**
+ * The frame_buffers of one hdlc_state_machine.  A buffer taken from the
+ * pool is kept by its user until released, then reused.  The pool only
+ * allocates when more buffers are in use at once than ever before, so
+ * it stops allocating once decoding reaches a steady state.
+ */
+class frame_pool
+{
+public:
+
+    explicit frame_pool(size_t size) : buffers_(), free_()
+    {
+        for (size_t i = 0; i != size; ++i) grow();
+    }
+
+    ~frame_pool()
+    {
+        for (size_t i = 0; i != buffers_.size(); ++i) delete buffers_[i];
+    }
+
+    frame_buffer* acquire()
+    {
+        if (free_.empty()) grow();
+
+        frame_buffer* result = free_.back();
+        free_.pop_back();
+        result->clear();
+        return result;
+    }
+
+    void release(frame_buffer* buffer)
+    {
+        free_.push_back(buffer);
+    }
+
+private:
+
+    frame_pool(const frame_pool&);
+    frame_pool& operator=(const frame_pool&);
+
+    void grow()
+    {
+        buffers_.push_back(new frame_buffer);
+        free_.reserve(buffers_.size());     // So release() never allocates.
+        free_.push_back(buffers_.back());
+    }
+
+    std::vector<frame_buffer*> buffers_;
+    std::vector<frame_buffer*> free_;
+};
+
+/**
+ * Repairs frames that fail the FCS check using soft bits.  The input
+ * bits are kept as they arrive.  When a frame with a bad FCS ends, its
+ * bits are found in the history and unstuffed, and the CANDIDATES data
+ * bits with the lowest confidence are flipped, up to max_flips_ at a
+ * time, looking for a combination that makes the FCS good.
+ *
+ * The CRC is linear, so flipping data bit k changes the final CRC
+ * register by a syndrome that depends only on the number of bits after
+ * k.  Each combination is tested by XORing the syndromes of its bits
+ * against the error in the register, without running the CRC again.
+ * Only a combination that matches is checked in full: it must leave
+ * the bit stuffing unchanged, so that the flips alone explain the bits
+ * that were received.
+ *
+ * The cost is bounded by the number of combinations, at most 696 for
+ * three flips.  Each combination tried adds to the chance that a frame
+ * too damaged to repair is passed with a wrong, but valid, FCS, so one
+ * or two flips are a better choice than three.
+ */
+struct soft_bit_repair
+{
+    static const size_t HISTORY = 4096;     ///< Bits kept; a power of 2.
+    static const int CANDIDATES = 16;
+    static const int MAX_FLIPS = 3;
+
+    int max_flips_;
+    std::vector<int8_t> history_;
+    uint64_t count_;        ///< Bits added so far.
+    uint64_t repaired_;     ///< Frames repaired so far.
+
+    // Working space for repair(), kept to avoid allocating for each frame.
+    std::vector<uint8_t> bits_;         ///< Unstuffed data bits.
+    std::vector<uint8_t> confidence_;   ///< Confidence of each data bit.
+    std::vector<uint8_t> stuffed_;      ///< Whether a zero was stuffed after it.
+    std::vector<uint16_t> syndrome_;
+    std::vector<size_t> candidates_;    ///< Data bits, least confident first.
+    size_t ncandidates_;
+    size_t flips_[MAX_FLIPS];
+
+    soft_bit_repair(int max_flips);
+
+    /// Add the next soft bit: positive for a 1, otherwise 0.
+    void operator()(int8_t soft)
+    {
+        history_[count_++ & (HISTORY - 1)] = soft;
+    }
+
+    /**
+     * Try to repair @p frame, which has just been ended by a flag within
+     * the last eight bits added.
+     *
+     * @return true if it was repaired, in which case @p frame holds the
+     *  corrected bytes.
+     */
+    bool repair(frame_buffer& frame);
+
+private:
+
+    bool bit(uint64_t i) const { return history_[i & (HISTORY - 1)] > 0; }
+    bool flag_ends_at(uint64_t i) const;
+    bool unstuff(uint64_t begin, uint64_t end, const frame_buffer& frame);
+    bool search(frame_buffer& frame);
+    bool combine(size_t first, int depth, int nflips, uint16_t error,
+        frame_buffer& frame);
+    bool apply(int nflips, frame_buffer& frame);
+};
+
 /**
  * This implements a state machine for HDLC frame parsing.  It uses
  * a 16-bit (2-byte) buffer to scan for flags and data.
@@ -56,64 +371,101 @@ namespace detail {
  * - An invalid bit sequence is encountered.  In this case the frame
  *   is aborted and the state transitions to SEARCH.
  *
- * Bits are pushed
+ * If no frame is completed within TIMEOUT bits of entering HUNT or
+ * FRAME, the state machine goes back to SEARCH.  That is long enough
+ * for the longest frame, 331 bytes with a zero stuffed after every five
+ * bits, and its flags: about 2.7 seconds at 1200 baud.
+ * The timeout is counted in bits as they are pushed, so no clock or
+ * timer thread is needed.
+ *
+ * Bits are pushed one at a time with operator(), or eight at a time
+ * with push_byte().  push_byte() uses the hdlc_tables to handle the
+ * common cases -- searching through noise and accumulating frame
+ * data -- in a single step.  Whenever the eight bits would cause a
+ * state transition, they are fed through operator() one at a time,
+ * so both produce exactly the same frames.  push_word() takes 64 bits
+ * at a time in the same way, but leaves the caller to push the bits a
+ * byte at a time from the first one it cannot handle.
+ *
+ * If repair_ is set, a frame with a bad FCS is handed to it before it
+ * is dropped or passed on.
+ *
+ * Events are counted in counts_, the same whichever way the bits are
+ * pushed, for the caller to collect and clear.
  */
 struct hdlc_state_machine
 {
     static const uint16_t FLAG = 0x7E00;
     static const uint16_t ABORT = 0x7F;
     static const uint16_t IDLE = 0xFF;
+    static const int TIMEOUT = 331 * 8 * 6 / 5 + 16;
+    static const size_t POOL_SIZE = 4;
 
     enum state {SEARCH, HUNT, FRAMING};
 
+    /// What happened, for hdlc_framer_stats.
+    struct counts
+    {
+        uint64_t flags;
+        uint64_t frames;
+        uint64_t good;
+        uint64_t bad;
+        uint64_t too_short;
+        uint64_t too_long;
+        uint64_t stuff_errors;
+        uint64_t timeouts;
+
+        counts() { clear(); }
+
+        void clear()
+        {
+            flags = frames = good = bad = 0;
+            too_short = too_long = stuff_errors = timeouts = 0;
+        }
+    };
+
     state state_;
     int ones_;
     uint16_t buffer_;
-    std::string frame_;
+    frame_pool pool_;
+    frame_buffer* frame_;   ///< Taken from pool_.
+    crc_ccitt crc_;
     bool ready_;
     int bits_;
-    boost::asio::io_service io_;
-    boost::asio::deadline_timer timer_;
-    boost::posix_time::time_duration timeout_;
-    boost::scoped_ptr<boost::thread> thread_;
+    int timer_;     ///< Bits left before the timeout, or 0 if not running.
+    int frame_bits_;    ///< The length of the frame that is ready.
     bool passall_;
+    log_sink::sptr log_;    ///< Set and read with boost::atomic_*().
+    soft_bit_repair* repair_;
+    counts counts_;
 
     hdlc_state_machine(bool pass_all)
     : state_(SEARCH), ones_(0)
-    , buffer_(0), frame_(), ready_(false), bits_(0)
-    , io_(), timer_(io_), timeout_(boost::posix_time::seconds(2))
-    , thread_(), passall_(pass_all)
+    , buffer_(0), pool_(POOL_SIZE), frame_(pool_.acquire())
+    , crc_(), ready_(false), bits_(0)
+    , timer_(0), frame_bits_(0), passall_(pass_all), log_(), repair_(0)
+    , counts_()
+    {}
+
+    void start_timer()
     {
-        thread_.reset(new boost::thread(&hdlc_state_machine::async_thread, this));
+        timer_ = TIMEOUT;
     }
 
-    void async_thread()
+    void cancel_timer()
     {
-        std::clog << "thread running..." << std::endl;
-        io_.run();
+        timer_ = 0;
     }
 
-    void timer_handler(const boost::system::error_code& ec)
+    void tick()
     {
-        if (!ec)
+        if (timer_ != 0 and --timer_ == 0)
         {
             state_ = SEARCH;
+            ++counts_.timeouts;
         }
     }
 
-    void start_timer()
-    {
-        timer_.expires_from_now(timeout_);
-        timer_.async_wait(
-            boost::bind(&hdlc_state_machine::timer_handler, this, _1));
-    }
-
-    void cancel_timer()
-    {
-        boost::system::error_code ec;
-        timer_.cancel(ec);
-    }
-
     void add_bit(char c)
     {
         const uint16_t BIT = 0x8000;
@@ -166,6 +518,7 @@ struct hdlc_state_machine
 
     void go_hunt()
     {
+        ++counts_.flags;
         state_ = HUNT;
         bits_ = 0;
         buffer_ = 0;
@@ -227,8 +580,10 @@ struct hdlc_state_machine
 
     void go_frame()
     {
+        ++counts_.frames;
         state_ = FRAMING;
-        frame_.clear();
+        frame_->clear();
+        crc_.reset();
         ones_ = 0;
         buffer_ &= 0xFF00;
         start_timer();
@@ -243,11 +598,11 @@ struct hdlc_state_machine
 
         if (bits_ != 8) return;
 
-        if (have_flag())
+        if ((buffer_ & MASK) == FLAG)
         {
             go_hunt();
         }
-        if (have_bogon())
+        else if (have_bogon())
         {
             go_search();
         }
@@ -274,19 +629,16 @@ struct hdlc_state_machine
 
             if (bits_ == 16)
             {
-                frame_.push_back(getchar());
+                add_byte(getchar());
 
                 consume_byte();
                 if (have_flag())
                 {
-                    if (frame_.size() > 17)
-                    {
-                        output_frame();
-                    }
-                    go_hunt();
+                    end_frame();
                 }
-                else if (frame_.size() > 330)
+                else if (frame_->size() > 330)
                 {
+                    ++counts_.too_long;
                     go_search();
                 }
             }
@@ -299,24 +651,24 @@ struct hdlc_state_machine
             {
                 ones_ = 0;
                 consume_bit();
-                return;
-            }
-            else if (frame_end())
-            {
-                std::clog << "how did we get here?" << std::endl;
 
-                output_frame();
-                go_hunt();
+                // When the zero was stuffed after the last bit of a byte,
+                // the closing flag can follow it at once.
+                if (bits_ == 8 and have_flag()) end_frame();
+                return;
             }
             else
             {
                 // Framing error.  Drop the frame.  If there is a FLAG
                 // in the buffer, go into HUNT otherwise SEARCH.
 
+                ++counts_.stuff_errors;
+
                 if ((buffer_ >> (16 - bits_) & 0xFF) == 0x7E)
                 {
                     // Cannot call go_hunt() here because we need
                     // to preserve buffer state.
+                    ++counts_.flags;
                     bits_ -= 8;
                     state_ = HUNT;
                 }
@@ -328,42 +680,58 @@ struct hdlc_state_machine
         }
     }
 
-    bool frame_end()
+    /// A flag has followed the last byte of the frame.
+    void end_frame()
     {
-        uint16_t tmp = (buffer_ >> (16 - bits_));
-        return (tmp & 0xFF) == FLAG;
+        if (frame_->size() > 17)
+        {
+            output_frame();
+        }
+        else
+        {
+            ++counts_.too_short;
+        }
+        go_hunt();
+    }
+
+    void add_byte(char c)
+    {
+        frame_->push_back(c);
+        crc_(c);
     }
 
+    /**
+     * The CRC has been computed as the frame arrived.  Frames with a
+     * bad CRC are repaired if they can be, and otherwise dropped unless
+     * passall_ is set.  Frames are handed to the log sink, if there is
+     * one, which must not block.
+     */
     void output_frame()
     {
-        try
-        {
-            ax25_frame frame(frame_);
+        // go_frame() started the timer on the eighth bit after the
+        // opening flag.
+        frame_bits_ = TIMEOUT - timer_ + 8;
 
-            std::clog << boost::posix_time::to_simple_string(
-                boost::posix_time::second_clock().local_time()) << std::endl;
+        bool good = crc_.good();
 
-            std::cout << "\07\07\07";
+        if (not good and repair_ and repair_->repair(*frame_))
+        {
+            crc_.reset();
+            crc_(frame_->data(), frame_->size());
+            good = crc_.good();
+        }
 
-            write(std::cout, frame);
+        if (good) ++counts_.good; else ++counts_.bad;
+
+        if (good or passall_)
+        {
+            const log_sink::sptr log = boost::atomic_load(&log_);
+            if (log) log->frame(frame_->data(), frame_->size(), good);
             ready_ = true;
         }
-        catch (bad_frame& ex)
+        else
         {
-            if (passall_)
-            {
-                std::clog << boost::posix_time::to_simple_string(
-                        boost::posix_time::second_clock().local_time())
-                    << std::endl;
-
-                std::cout << "\07\07\07";
-                report_frame_error();
-                ready_ = true;
-            }
-            else
-            {
-                frame_.clear();
-            }
+            frame_->clear();
         }
     }
 
@@ -377,35 +745,338 @@ struct hdlc_state_machine
     {
         bits_ = 8;
         buffer_ &= 0xFF00;
-        frame_.clear();
+        frame_->clear();
     }
 
-    void report_frame_error()
+    bool ready() const
     {
-        if (frame_.size() > 17)
-        {
-            write(std::clog, sloppy_ax25_frame(frame_));
-        }
+        return ready_;
     }
 
-    bool ready() const
+    /// The CRC computed over the frame that is ready.
+    uint16_t checksum() const
     {
-        return ready_;
+        assert(ready_);
+        return crc_.checksum();
     }
 
     std::string frame()
     {
         assert(ready_);
-        std::string result = frame_;
-        frame_.clear();
+        std::string result = frame_->str();
+        clear_frame();
+        return result;
+    }
+
+    /// The frame that is ready, without a copy.  Call clear_frame() when
+    /// done with it.
+    const frame_buffer& frame_data() const
+    {
+        assert(ready_);
+        return *frame_;
+    }
+
+    /**
+     * Take the frame that is ready, without a copy, to keep past the
+     * next one.  Give it back with release_frame() when done with it.
+     */
+    frame_buffer* take_frame()
+    {
+        assert(ready_);
+        frame_buffer* result = frame_;
+        frame_ = pool_.acquire();
         ready_ = false;
         return result;
     }
 
+    void release_frame(frame_buffer* frame)
+    {
+        pool_.release(frame);
+    }
+
+    void clear_frame()
+    {
+        frame_->clear();
+        ready_ = false;
+    }
+
+    /// Whether the frame that is ready has a valid FCS.
+    bool crc_ok() const
+    {
+        assert(ready_);
+        return crc_.good();
+    }
+
+    /**
+     * The number of bits the frame that is ready took, stuffed zeros
+     * included, from the first after its opening flag to the last of
+     * its closing flag.
+     */
+    int frame_bits() const
+    {
+        assert(ready_);
+        return frame_bits_;
+    }
+
+    /**
+     * The number of bits pushed since the frame that is ready was
+     * closed.  The closing flag restarted the timer, and the rest of
+     * the byte it ended in, fewer than eight bits, has been pushed
+     * since.
+     */
+    int bits_since_frame() const
+    {
+        assert(ready_);
+        return TIMEOUT - timer_;
+    }
+
+    /**
+     * Process eight bits, LSB first.
+     */
+    bool push_byte(uint8_t bits)
+    {
+        const hdlc_tables& tables = hdlc_tables::instance();
+
+        // A timeout within these bits is handled one bit at a time.
+        if (timer_ == 0 or timer_ > 8)
+        {
+            bool done = false;
+
+            switch (state_)
+            {
+            case SEARCH:
+                done = !tables.search_flag[tables.ones_run[buffer_ >> 8]][bits];
+                if (done)
+                {
+                    buffer_ = (bits << 8) | (buffer_ >> 8);
+                    bits_ += 8;
+                }
+                break;
+            case HUNT:
+                done = hunt_byte(bits);
+                break;
+            case FRAMING:
+                done = frame_byte(tables.unstuff[ones_][buffer_ >> 8], bits);
+                break;
+            default:
+                break;
+            }
+
+            if (done) return ready();
+        }
+
+        for (int i = 0; i != 8; ++i)
+        {
+            (*this)((bits >> i) & 1);
+        }
+
+        return ready();
+    }
+
+    /**
+     * Pass over eight bits of flags.  The hunt buffer is filled eight bits
+     * at a time from the flag that started the HUNT, so @p bits complete
+     * it and start the next one.  Returns false, without changing any
+     * state, unless they complete a flag.
+     */
+    bool hunt_byte(uint8_t bits)
+    {
+        const int held = bits_;
+        const unsigned int held_bits = (buffer_ >> (16 - held)) & 0xFF;
+
+        if (((held_bits | (bits << held)) & 0xFF) != (FLAG >> 8)) return false;
+
+        // The flag restarts the timer, which then counts the bits after it.
+        buffer_ = ((bits >> (8 - held)) << (16 - held)) & 0xFF00;
+        timer_ = TIMEOUT - held;
+        ++counts_.flags;
+        return true;
+    }
+
+    /**
+     * Accumulate eight bits of frame data.  The bits entering the data
+     * buffer are the ones in the top of the flag buffer; @p bits go into
+     * the flag buffer.  Returns false, without changing any state, if
+     * the bits contain an abort or could end the frame.
+     */
+    bool frame_byte(const hdlc_tables::unstuff_entry& entry, uint8_t bits)
+    {
+        if (entry.error != hdlc_tables::NO_ERROR) return false;
+
+        // A zero stuffed after the last bit of a byte can be followed by
+        // the closing flag, which frame() looks for there.
+        const int pending = bits_ - 8;
+        if (entry.stuffed & (1 << ((8 - pending) & 7))) return false;
+
+        const int total = pending + entry.count;
+        unsigned int data = ((buffer_ & 0xFF) >> (8 - pending))
+            | (entry.bits << pending);
+
+        if (total >= 8)
+        {
+            // The bit that completes a byte and the flag buffer at the
+            // time it arrives.
+            const int needed = 8 - pending;
+            const int position = (entry.position >> (3 * (needed - 1))) & 7;
+            const unsigned int window = (buffer_ >> 8) | (bits << 8);
+            const uint16_t flag = (window << (7 - position)) & 0xFF00;
+
+            if ((flag & FLAG) == FLAG) return false;
+            if (frame_->size() + 1 > 330) return false;
+
+            add_byte(data & 0xFF);
+            data >>= 8;
+        }
+
+        const int remaining = total & 7;
+        buffer_ = (bits << 8) | ((data << (8 - remaining)) & 0xFF);
+        bits_ = 8 + remaining;
+        ones_ = entry.ones;
+
+        if (timer_ != 0) timer_ -= 8;
+
+        return true;
+    }
+
+    /**
+     * Process 64 bits, LSB first, with word-parallel tests rather than a
+     * byte at a time.  While searching, the noise is skipped up to the
+     * byte in which six ones end; in HUNT and FRAMING the word must be
+     * all flags or all frame data.  Returns the number of whole bytes of
+     * @p bits consumed.  The next byte must then be pushed with
+     * push_byte().
+     */
+    int push_word(uint64_t bits)
+    {
+        switch (state_)
+        {
+        case SEARCH:
+            return search_word(bits);
+        case HUNT:
+            return hunt_word(bits) ? 8 : 0;
+        case FRAMING:
+            return frame_word(bits) ? 8 : 0;
+        default:
+            return 0;
+        }
+    }
+
+    /**
+     * Skip the bits before the first byte that would enter HUNT, which
+     * search() does when the six bits before the current one are ones.
+     */
+    int search_word(uint64_t bits)
+    {
+        if (timer_ != 0) return 0;
+
+        const uint64_t prior = uint64_t(buffer_) << 48;
+        uint64_t after_six = ~uint64_t(0);
+        for (int k = 1; k != 7; ++k)
+        {
+            after_six &= (bits << k) | (prior >> (64 - k));
+        }
+
+        int nbytes = 8;
+        if (after_six != 0)
+        {
+            nbytes = 0;
+            while (((after_six >> (8 * nbytes)) & 0xFF) == 0) ++nbytes;
+        }
+
+        // Keep the last 16 bits skipped, as search() would.
+        if (nbytes == 1)
+        {
+            buffer_ = ((bits & 0xFF) << 8) | (buffer_ >> 8);
+        }
+        else if (nbytes != 0)
+        {
+            buffer_ = bits >> (8 * nbytes - 16);
+        }
+        bits_ += 8 * nbytes;
+
+        return nbytes;
+    }
+
+    /// hunt_byte() for 64 bits, which must all be flags.
+    bool hunt_word(uint64_t bits)
+    {
+        const uint64_t FLAGS = 0x7E7E7E7E7E7E7E7EULL;
+
+        if (timer_ <= 64) return false;
+
+        const int held = bits_;
+        const uint64_t held_bits = (buffer_ >> (16 - held)) & 0xFF;
+
+        if ((held_bits | (bits << held)) != FLAGS) return false;
+
+        buffer_ = held ? ((bits >> (64 - held)) << (16 - held)) & 0xFF00 : 0;
+        timer_ = TIMEOUT - held;
+        counts_.flags += 8;
+        return true;
+    }
+
+    /**
+     * Add 64 bits of frame data in a single step, unstuffing them with
+     * the hdlc_word masks rather than one bit at a time.  Returns false,
+     * without changing any state, if the bits are not all frame data.
+     */
+    bool frame_word(uint64_t bits)
+    {
+        if (timer_ != 0 and timer_ <= 64) return false;
+        if (frame_->size() + 8 > 330) return false;
+
+        // The ones_ run ends just before the flag buffer, behind a zero.
+        const uint64_t run = ones_ ? ~uint64_t(0) << (64 - ones_) : 0;
+        const uint64_t window = buffer_ >> 8;
+
+        // Without a sixth one there can be no flag, abort or framing
+        // error, neither in the data nor in the flag buffer.
+        const uint64_t data = window | (bits << 8);
+        const hdlc_word entering(data, run);
+        if (entering.sixth) return false;
+
+        const hdlc_word arriving(bits, (window << 56) | (run >> 8));
+        if (arriving.sixth) return false;
+
+        int count = 0;
+        uint64_t unstuffed = hdlc_word::unstuff(data, entering.stuffed, count);
+
+        // Complete the pending byte, then add whole bytes.
+        const int pending = bits_ - 8;
+        char bytes[9];
+        int nbytes = 0;
+
+        bytes[nbytes++] = ((buffer_ & 0xFF) >> (8 - pending))
+            | (unstuffed << pending);
+        unstuffed >>= (8 - pending);
+        count -= (8 - pending);
+
+        for (; count >= 8; count -= 8)
+        {
+            bytes[nbytes++] = unstuffed & 0xFF;
+            unstuffed >>= 8;
+        }
+
+        frame_->append(bytes, nbytes);
+        crc_(bytes, nbytes);
+
+        buffer_ = ((bits >> 56) << 8) | ((unstuffed << (8 - count)) & 0xFF);
+        bits_ = 8 + count;
+
+        ones_ = 0;
+        while (ones_ != 5 and (data >> (63 - ones_)) & 1) ++ones_;
+
+        if (timer_ != 0) timer_ -= 64;
+
+        return true;
+    }
+
     bool operator()(char c)
     {
         c &= 1; // One bit only
 
+        tick();
+
         switch (state_)
         {
         case SEARCH:
@@ -425,22 +1096,95 @@ struct hdlc_state_machine
     }
 };
 
-} // detail
+/// A quality report from afsk1200_demod, taken from its stream tag.
+struct demod_report
+{
+    uint64_t bit;
+    uint64_t sample;
+    double level;
+    double timing_error;
+    double twist;
+    bool tones;
+};
 
+/// The demod_reports made while a frame arrived, summed up.
+struct frame_quality
+{
+    uint64_t start_sample;
+    uint64_t end_sample;
+    double level;
+    double timing_error;
+    double twist;
+    bool located;       ///< Whether the samples are known.
+    bool tones;         ///< Whether level and twist are known.
+};
 
-class MOBILINKD_API hdlc_framer_impl : public virtual hdlc_framer
+/**
+ * The last CAPACITY demod_reports, which cover the longest frame, so
+ * that the ones made while a frame arrived can be summed up once it is
+ * complete.  The slots are allocated up front.
+ */
+class report_history
 {
 public:
-    typedef boost::shared_ptr<hdlc_framer_impl> sptr;
 
-    static sptr make(bool pass_all)
+    static const size_t CAPACITY = 64;
+
+    report_history() : reports_(CAPACITY), next_(0), size_(0) {}
+
+    void add(const demod_report& report)
     {
-        return sptr(new hdlc_framer_impl(pass_all));
+        reports_[next_] = report;
+        next_ = (next_ + 1) % CAPACITY;
+        size_ = std::min(size_ + 1, CAPACITY);
     }
 
-    static sptr make(bool pass_all, gr_msg_queue_sptr msgq)
+    /**
+     * Sum up the reports for bits @p start to @p end.  The samples are
+     * extrapolated from the first and last of them, and so need two.
+     * Returns false if there are none.
+     */
+    bool summarize(uint64_t start, uint64_t end, frame_quality& quality) const;
+
+private:
+
+    std::vector<demod_report> reports_;
+    size_t next_;
+    size_t size_;
+};
+
+/**
+ * Add the "destination" and "source" of @p frame to the PDU metadata
+ * @p meta as callsign values, so that PDUs can be filtered and routed
+ * without parsing the frame again.  A frame too short to hold them is
+ * left without them.
+ */
+inline pmt::pmt_t add_addresses(pmt::pmt_t meta,
+    const ax25_frame_view& frame,
+    const pmt::pmt_t& destination_key, const pmt::pmt_t& source_key)
+{
+    if (not frame.valid()) return meta;
+
+    meta = pmt::pmt_dict_add(meta, destination_key,
+        pmt::pmt_from_uint64(frame.destination().value()));
+    meta = pmt::pmt_dict_add(meta, source_key,
+        pmt::pmt_from_uint64(frame.source().value()));
+    return meta;
+}
+
+} // detail
+
+
+class MOBILINKD_API hdlc_framer_impl : public virtual hdlc_framer
+{
+public:
+    typedef boost::shared_ptr<hdlc_framer_impl> sptr;
+
+    static sptr make(bool pass_all, gr_msg_queue_sptr msgq,
+        int output, int channel, int max_flips, bool packed)
     {
-        return sptr(new hdlc_framer_impl(pass_all, msgq));
+        return sptr(new hdlc_framer_impl(
+            pass_all, msgq, output, channel, max_flips, packed));
     }
 
     virtual int work(
@@ -450,15 +1194,75 @@ public:
 
     virtual gr_msg_queue_sptr msgq() const { return msgq_; }
 
+    virtual void set_log_sink(log_sink::sptr sink)
+    {
+        boost::atomic_store(&state_.log_, sink);
+    }
+
+    virtual void set_frame_ring(frame_ring::sptr ring)
+    {
+        boost::atomic_store(&ring_, ring);
+    }
+
+    virtual uint64_t frames_repaired() const
+    {
+        return stats_.get(FRAMES_REPAIRED);
+    }
+
+    virtual hdlc_framer_stats get_stats() const;
+
     virtual ~hdlc_framer_impl() {}
 
 private:
 
-    hdlc_framer_impl(bool pass_all);
-    hdlc_framer_impl(bool pass_all, gr_msg_queue_sptr msgq);
+    hdlc_framer_impl(bool pass_all, gr_msg_queue_sptr msgq,
+        int output, int channel, int max_flips, bool packed);
+
+    void send_frame(uint64_t offset);
+    void send_text(const detail::frame_buffer& frame);
+    void send_pdu(
+        const detail::frame_buffer& frame, uint64_t start, uint64_t end);
+
+    /// Keep the quality reports tagged on the next @p size input items.
+    void read_reports(int size);
+
+    /// Add the counts from a call to work() that began at @p start.
+    void update_stats(uint64_t bits, gruel::high_res_timer_type start);
+
+    enum stat
+    {
+        BITS_IN, FLAGS, FRAMES_ATTEMPTED, FRAMES_OK, CRC_FAILURES,
+        TOO_SHORT, TOO_LONG, STUFF_ERRORS, TIMEOUTS, FRAMES_REPAIRED,
+        WORK_CALLS, WORK_NS, MAX_WORK_NS, NSTATS
+    };
 
     gr_msg_queue_sptr msgq_;
+    frame_ring::sptr ring_;
     detail::hdlc_state_machine state_;
+    detail::soft_bit_repair repair_;
+    bool packed_;
+    uint8_t pending_bits_;
+    int pending_count_;
+    int output_;
+    int channel_;
+    pmt::pmt_t pdu_port_;
+    pmt::pmt_t crc_ok_key_;
+    pmt::pmt_t offset_key_;
+    pmt::pmt_t channel_key_;
+    pmt::pmt_t start_key_;
+    pmt::pmt_t destination_key_;
+    pmt::pmt_t source_key_;
+    pmt::pmt_t start_sample_key_;
+    pmt::pmt_t end_sample_key_;
+    pmt::pmt_t level_key_;
+    pmt::pmt_t timing_error_key_;
+    pmt::pmt_t twist_key_;
+    pmt::pmt_t quality_key_;
+    pmt::pmt_t sample_key_;
+    std::vector<gr_tag_t> tags_;
+    detail::report_history reports_;
+    detail::block_stats<NSTATS> stats_;
+    uint64_t repaired_;     ///< repair_.repaired_ as last counted.
 };
 
 }} // gr::mobilinkd
@@ -0,0 +1,132 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#include "log_sink.h"
+#include "ax25_frame_view.h"
+
+#include <boost/lockfree/queue.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/date_time/c_local_time_adjustor.hpp>
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+namespace gr { namespace mobilinkd {
+
+namespace {
+
+struct null_log_sink : public log_sink
+{
+    virtual void frame(const char*, size_t, bool) {}
+};
+
+/**
+ * Frames are copied into fixed size records so that queuing a frame
+ * never allocates.
+ */
+struct log_record
+{
+    static const size_t MAX_SIZE = MAX_FRAME_SIZE;
+
+    std::time_t time;
+    uint16_t size;
+    bool crc_ok;
+    char data[MAX_SIZE];
+};
+
+class console_log_sink : public log_sink
+{
+public:
+
+    console_log_sink()
+    : queue_(), dropped_(0), done_(false)
+    , thread_(&console_log_sink::run, this)
+    {}
+
+    virtual ~console_log_sink()
+    {
+        done_ = true;
+        thread_.join();
+    }
+
+    virtual void frame(const char* data, size_t size, bool crc_ok)
+    {
+        log_record record;
+        record.time = std::time(0);
+        record.size = std::min(size, log_record::MAX_SIZE);
+        record.crc_ok = crc_ok;
+        std::memcpy(record.data, data, record.size);
+
+        if (!queue_.bounded_push(record))
+        {
+            dropped_.fetch_add(1, boost::memory_order_relaxed);
+        }
+    }
+
+    virtual unsigned long dropped() const
+    {
+        return dropped_.load(boost::memory_order_relaxed);
+    }
+
+private:
+
+    static const int POLL_INTERVAL_MS = 50;
+
+    void run()
+    {
+        log_record record;
+
+        while (!done_)
+        {
+            while (queue_.pop(record)) write_record(record);
+
+            boost::this_thread::sleep(
+                boost::posix_time::milliseconds(POLL_INTERVAL_MS));
+        }
+
+        while (queue_.pop(record)) write_record(record);
+    }
+
+    static void write_record(const log_record& record)
+    {
+        typedef boost::date_time::c_local_adjustor<boost::posix_time::ptime>
+            local_adjustor;
+
+        std::clog << boost::posix_time::to_simple_string(
+            local_adjustor::utc_to_local(
+                boost::posix_time::from_time_t(record.time))) << std::endl;
+
+        std::cout << "\07\07\07";
+
+        if (not record.crc_ok and record.size <= 17) return;
+
+        // Good frames go to cout and bad ones to clog.
+        ax25_frame_view frame(record.data, record.size);
+        write(record.crc_ok ? std::cout : std::clog, frame,
+            record.crc_ok ? ax25_frame::STRICT : ax25_frame::SLOPPY);
+    }
+
+    boost::lockfree::queue<log_record, boost::lockfree::capacity<64> > queue_;
+    boost::atomic<unsigned long> dropped_;
+    boost::atomic<bool> done_;
+    boost::thread thread_;
+};
+
+} // namespace
+
+log_sink::sptr log_sink::make_null()
+{
+    return sptr(new null_log_sink);
+}
+
+log_sink::sptr log_sink::make_console()
+{
+    static sptr instance(new console_log_sink);
+    return instance;
+}
+
+}} // gr::mobilinkd
@@ -0,0 +1,224 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#include "multichannel_afsk_rx_impl.h"
+#include "hdlc_framer.h"
+#include "ax25_frame_view.h"
+
+#include <gnuradio/gr_io_signature.h>
+#include <gnuradio/filter/firdes.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <sstream>
+
+namespace gr { namespace mobilinkd {
+
+multichannel_afsk_rx::sptr multichannel_afsk_rx::make(
+    int rate, int nchannels, const std::vector<int>& channels,
+    gr_msg_queue_sptr msgq, int output)
+{
+    return multichannel_afsk_rx_impl::make(
+        rate, nchannels, channels, msgq, output);
+}
+
+
+namespace detail {
+
+const float fm_discriminator::DC_POLE = 0.999F;
+
+pfb_channelizer::pfb_channelizer(int nchannels, const std::vector<float>& taps)
+: nchannels_(nchannels)
+, ntaps_((taps.size() + nchannels - 1) / nchannels)
+, taps_(ntaps_ * nchannels, 0.0)
+, history_(ntaps_ * nchannels, gr_complex(0))
+, row_(0)
+, fft_(nchannels, false)
+{
+    std::copy(taps.begin(), taps.end(), taps_.begin());
+}
+
+void pfb_channelizer::operator()(const gr_complex* input)
+{
+    const size_t M = nchannels_;
+
+    row_ = (row_ == 0 ? ntaps_ : row_) - 1;
+
+    gr_complex* newest = &history_[row_ * M];
+    for (size_t i = 0; i != M; ++i)
+    {
+        newest[M - 1 - i] = input[i];
+    }
+
+    gr_complex* branch = fft_.get_inbuf();
+    std::fill(branch, branch + M, gr_complex(0));
+
+    for (size_t l = 0; l != ntaps_; ++l)
+    {
+        const float* taps = &taps_[l * M];
+        const gr_complex* samples = &history_[((row_ + l) % ntaps_) * M];
+
+        for (size_t p = 0; p != M; ++p)
+        {
+            branch[p] += taps[p] * samples[p];
+        }
+    }
+
+    fft_.execute();
+}
+
+} // detail
+
+
+multichannel_afsk_rx_impl::multichannel_afsk_rx_impl(
+    int rate, int nchannels, const std::vector<int>& channels,
+    gr_msg_queue_sptr msgq, int output)
+: gr_sync_block("multichannel_afsk_rx",
+    gr_make_io_signature(1, 1, sizeof(gr_complex)),
+    gr_make_io_signature(0, 0, 0))
+, msgq_(msgq), log_()
+, output_(output), nchannels_(nchannels)
+, channelizer_(nchannels, prototype_taps(rate, nchannels))
+, block_(nchannels), block_size_(0), blocks_(0)
+, channels_()
+, pdu_port_(pmt::pmt_intern("pdus"))
+, crc_ok_key_(pmt::pmt_intern("crc_ok"))
+, offset_key_(pmt::pmt_intern("offset"))
+, channel_key_(pmt::pmt_intern("channel"))
+, destination_key_(pmt::pmt_intern("destination"))
+, source_key_(pmt::pmt_intern("source"))
+{
+    for (size_t i = 0; i != channels.size(); ++i)
+    {
+        const int channel = channels[i];
+
+        if (channel <= -nchannels or channel >= nchannels)
+        {
+            throw std::invalid_argument(
+                "multichannel_afsk_rx: channel out of range");
+        }
+
+        const size_t bin = (channel + nchannels) % nchannels;
+        channels_.push_back(boost::shared_ptr<detail::afsk_channel>(
+            new detail::afsk_channel(channel, bin, rate / nchannels)));
+    }
+
+    message_port_register_out(pdu_port_);
+}
+
+
+std::vector<float> multichannel_afsk_rx_impl::prototype_taps(
+    int rate, int nchannels)
+{
+    if (nchannels < 1 or rate % nchannels != 0)
+    {
+        throw std::invalid_argument(
+            "multichannel_afsk_rx: rate must be a multiple of nchannels");
+    }
+
+    // Pass 80% of the channel and stop at its edge.
+    const double width = double(rate) / nchannels;
+    return gr::filter::firdes::low_pass(1, rate, 0.4 * width, 0.2 * width);
+}
+
+
+int multichannel_afsk_rx_impl::work(
+    int size,
+    gr_vector_const_void_star& input_items,
+    gr_vector_void_star& output_items)
+{
+    const gr_complex* source =
+        reinterpret_cast<const gr_complex*>(input_items[0]);
+
+    const uint64_t first_block = blocks_;
+
+    for (int i = 0; i != size; ++i)
+    {
+        block_[block_size_] = source[i];
+        if (++block_size_ != block_.size()) continue;
+
+        channelizer_(&block_[0]);
+        const gr_complex* output = channelizer_.output();
+
+        for (size_t c = 0; c != channels_.size(); ++c)
+        {
+            detail::afsk_channel& channel = *channels_[c];
+            channel.audio_.push_back(
+                channel.discriminator_(output[channel.bin_]));
+        }
+
+        block_size_ = 0;
+        ++blocks_;
+    }
+
+    if (blocks_ == first_block) return size;
+
+    for (size_t c = 0; c != channels_.size(); ++c)
+    {
+        detail::afsk_channel& channel = *channels_[c];
+        detail::afsk1200_receiver& receiver = channel.receiver_;
+
+        receiver(&channel.audio_[0], channel.audio_.size(), first_block);
+        channel.audio_.clear();
+
+        for (size_t i = 0; i != receiver.frames_.size(); ++i)
+        {
+            send_frame(receiver.frames_[i]);
+        }
+        receiver.clear_frames();
+    }
+
+    return size;
+}
+
+
+void multichannel_afsk_rx_impl::send_frame(const decoded_frame& frame)
+{
+    const log_sink::sptr log = boost::atomic_load(&log_);
+    if (log) log->frame(frame.data->data(), frame.data->size(), true);
+
+    if (output_ & hdlc_framer::PDU_OUTPUT)
+    {
+        send_pdu(frame);
+    }
+
+    if (output_ & hdlc_framer::TEXT_OUTPUT)
+    {
+        send_text(frame);
+    }
+}
+
+
+void multichannel_afsk_rx_impl::send_text(const decoded_frame& data)
+{
+    ax25_frame_view frame(data.data->data(), data.data->size(), data.crc);
+    std::ostringstream output;
+    output << "Channel " << data.id << std::endl;
+    write(output, frame);
+    gr_message_sptr msg = gr_make_message_from_string(output.str());
+
+    msgq_->insert_tail(msg);         // send it
+}
+
+
+void multichannel_afsk_rx_impl::send_pdu(const decoded_frame& frame)
+{
+    // Offsets are counted in input samples, not channel samples.
+    pmt::pmt_t meta = pmt::pmt_make_dict();
+    meta = pmt::pmt_dict_add(meta, crc_ok_key_, pmt::pmt_from_bool(true));
+    meta = pmt::pmt_dict_add(meta, offset_key_,
+        pmt::pmt_from_uint64(frame.offset * nchannels_));
+    meta = pmt::pmt_dict_add(meta, channel_key_,
+        pmt::pmt_from_long(frame.id));
+
+    meta = detail::add_addresses(meta, ax25_frame_view(
+        frame.data->data(), frame.data->size(), frame.crc),
+        destination_key_, source_key_);
+
+    pmt::pmt_t bytes = pmt::pmt_init_u8vector(frame.data->size(),
+        reinterpret_cast<const uint8_t*>(frame.data->data()));
+
+    message_port_pub(pdu_port_, pmt::pmt_cons(meta, bytes));
+}
+
+}} // gr::mobilinkd
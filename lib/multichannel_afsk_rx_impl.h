@@ -0,0 +1,186 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#ifndef GR__MOBILINKD__MULTICHANNEL_AFSK_RX_IMPL_H_
+#define GR__MOBILINKD__MULTICHANNEL_AFSK_RX_IMPL_H_
+
+#include "multichannel_afsk_rx.h"
+#include "afsk1200_receiver.h"
+
+#include <gnuradio/gr_complex.h>
+#include <gnuradio/gri_fft.h>
+
+#include <gruel/pmt.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+#include <cmath>
+
+namespace gr { namespace mobilinkd {
+
+namespace detail {
+
+/**
+ * A critically sampled polyphase analysis filter bank.  Each block of
+ * M input samples produces one output sample for each of the M
+ * channels.
+ *
+ * The prototype low-pass filter is split into M branches, branch p
+ * holding taps p, p + M, p + 2M, ...  Input sample i of each block goes
+ * to branch M - 1 - i.  The branch outputs are then combined by an
+ * inverse FFT, which shifts channel k down to baseband.  This does the
+ * work of M frequency translating filters, each decimating by M, for
+ * the cost of one filter pass over the input and one M point FFT.
+ *
+ * The branch histories are kept as rows of M samples, so that each tap
+ * is applied to all M branches in one loop that can be vectorized.
+ */
+struct pfb_channelizer
+{
+    int nchannels_;
+    size_t ntaps_;              ///< Taps per branch.
+    std::vector<float> taps_;   ///< Row l holds taps l * M ... l * M + M - 1.
+    std::vector<gr_complex> history_;   ///< ntaps_ rows of M samples.
+    size_t row_;                ///< The row holding the newest samples.
+    gri_fft_complex fft_;
+
+    pfb_channelizer(int nchannels, const std::vector<float>& taps);
+
+    /**
+     * Filter one block of nchannels_ input samples.  The output for
+     * channel k is then output()[k].
+     */
+    void operator()(const gr_complex* input);
+
+    const gr_complex* output() const { return fft_.get_outbuf(); }
+};
+
+/**
+ * FM quadrature discriminator followed by a one pole DC blocker, which
+ * removes the offset caused by a transmitter that is off frequency.
+ * The audio level does not matter since the AFSK demodulator hard
+ * limits it.
+ */
+struct fm_discriminator
+{
+    static const float DC_POLE;
+
+    gr_complex last_;
+    float last_x_;
+    float last_y_;
+
+    fm_discriminator()
+    : last_(0), last_x_(0), last_y_(0)
+    {}
+
+    float operator()(const gr_complex& sample)
+    {
+        gr_complex product = sample * std::conj(last_);
+        last_ = sample;
+
+        float x = std::atan2(product.imag(), product.real());
+        float y = x - last_x_ + DC_POLE * last_y_;
+        last_x_ = x;
+        last_y_ = y;
+
+        return y;
+    }
+};
+
+/**
+ * One decoded channel.  Most channels are idle most of the time, so
+ * carrier detect is on and only audio with AFSK in it is demodulated.
+ *
+ * The audio is demodulated at the channel rate rounded down to a
+ * whole number of samples per bit, not at the usual working rate.
+ * Resampling a 12.5 kHz channel up to 24 kHz more than triples the work
+ * for each channel.  Resampling down to 12 kHz costs no more than
+ * running at the channel rate, and the resampler's filter keeps most of
+ * the noise out of the discriminator.
+ */
+struct afsk_channel
+{
+    size_t bin_;                ///< The channelizer output it is taken from.
+    fm_discriminator discriminator_;
+    afsk1200_receiver receiver_;
+    std::vector<float> audio_;
+
+    afsk_channel(int id, size_t bin, int rate)
+    : bin_(bin), discriminator_()
+    , receiver_(id, rate, 1200, .000448, 0, rate / 1200 * 1200), audio_()
+    {
+        receiver_.demod_.set_carrier_threshold(
+            carrier_detector::DEFAULT_THRESHOLD);
+    }
+};
+
+} // detail
+
+class MOBILINKD_API multichannel_afsk_rx_impl
+: public virtual multichannel_afsk_rx
+{
+public:
+    typedef boost::shared_ptr<multichannel_afsk_rx_impl> sptr;
+
+    static sptr make(int rate, int nchannels, const std::vector<int>& channels,
+        gr_msg_queue_sptr msgq, int output)
+    {
+        return sptr(new multichannel_afsk_rx_impl(
+            rate, nchannels, channels, msgq, output));
+    }
+
+    virtual int work(
+        int noutput_items,
+        gr_vector_const_void_star& input_items,
+        gr_vector_void_star& output_items);
+
+    virtual gr_msg_queue_sptr msgq() const { return msgq_; }
+
+    virtual void set_log_sink(log_sink::sptr sink)
+    {
+        boost::atomic_store(&log_, sink);
+    }
+
+    virtual ~multichannel_afsk_rx_impl() {}
+
+private:
+
+    typedef detail::afsk1200_receiver::decoded_frame decoded_frame;
+
+    multichannel_afsk_rx_impl(int rate, int nchannels,
+        const std::vector<int>& channels, gr_msg_queue_sptr msgq, int output);
+
+    static std::vector<float> prototype_taps(int rate, int nchannels);
+
+    void send_frame(const decoded_frame& frame);
+    void send_text(const decoded_frame& frame);
+    void send_pdu(const decoded_frame& frame);
+
+    gr_msg_queue_sptr msgq_;
+    log_sink::sptr log_;
+    int output_;
+    int nchannels_;
+
+    detail::pfb_channelizer channelizer_;
+
+    // The channelizer takes whole blocks of nchannels_ samples.  The
+    // rest of a partial block is kept until the next call.
+    std::vector<gr_complex> block_;
+    size_t block_size_;
+    uint64_t blocks_;   ///< Blocks channelized, i.e. samples per channel.
+
+    // The demodulators own FIR filters, which cannot be copied.
+    std::vector<boost::shared_ptr<detail::afsk_channel> > channels_;
+
+    pmt::pmt_t pdu_port_;
+    pmt::pmt_t crc_ok_key_;
+    pmt::pmt_t offset_key_;
+    pmt::pmt_t channel_key_;
+    pmt::pmt_t destination_key_;
+    pmt::pmt_t source_key_;
+};
+
+}} // gr::mobilinkd
+
+#endif // GR__MOBILINKD__MULTICHANNEL_AFSK_RX_IMPL_H_
@@ -0,0 +1,361 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#include "afsk1200_demod_impl.h"
+#include "test_signals.h"
+
+#include <gnuradio/gr_math.h>
+#include <gnuradio/filter/firdes.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+using namespace gr::mobilinkd;
+
+namespace {
+
+const size_t BURSTS = 10;
+
+/**
+ * The fewest bits of @p output that differ from @p sent[lo, hi), over
+ * the alignments the demodulator's delay can give.  The alignment is
+ * returned in @p offset.
+ */
+size_t best_errors(const std::vector<unsigned char>& output,
+    const test::bit_vector& sent, size_t lo, size_t hi, size_t& offset)
+{
+    size_t best = hi - lo;
+    offset = 0;
+
+    for (size_t k = 0; k + hi <= output.size() and k != 700; ++k)
+    {
+        size_t errors = 0;
+        for (size_t j = lo; j != hi and errors < best; ++j)
+        {
+            errors += output[k + j] != sent[j];
+        }
+        if (errors < best)
+        {
+            best = errors;
+            offset = k;
+        }
+    }
+
+    return best;
+}
+
+/// Round @p audio to 16 bits, as a sound card would give it.
+void quantize(const std::vector<float>& audio,
+    std::vector<int16_t>& fixed, std::vector<float>& floating)
+{
+    fixed.resize(audio.size());
+    floating.resize(audio.size());
+    for (size_t i = 0; i != audio.size(); ++i)
+    {
+        const float x = std::max(-1.0F, std::min(1.0F, audio[i] * 0.45F));
+        fixed[i] = int16_t(x * 32767);
+        floating[i] = fixed[i] / 32768.0F;
+    }
+}
+
+/**
+ * The demodulator as it was first fused into one block, which gave the
+ * same bits as the chain of blocks before it.  With no working rate,
+ * afsk1200_demodulator must still give the same bits.
+ */
+struct reference_demodulator
+{
+    std::vector<unsigned char> delay_line_;
+    size_t delay_pos_;
+    gr::filter::kernel::fir_filter_fff filter_;
+    std::vector<float> filter_history_;
+    detail::dc_blocker<float> dc_blocker_;
+    gri_mmse_fir_interpolator_ff interp_;
+    std::vector<float> filtered_;
+    size_t index_;
+    float mu_;
+    float omega_;
+    float omega_mid_;
+    float omega_lim_;
+    float last_sample_;
+
+    explicit reference_demodulator(int rate)
+    : delay_line_(int(.000448 / (1.0 / rate)), 0), delay_pos_(0)
+    , filter_(1, gr::filter::firdes::low_pass(1, rate, 1200, 300))
+    , filter_history_(filter_.ntaps() - 1, 0.0)
+    , dc_blocker_(1024)
+    , interp_(), filtered_(), index_(0)
+    , mu_(.240), omega_(rate / 1200), omega_mid_(omega_)
+    , omega_lim_(omega_mid_ * .00005F), last_sample_(0)
+    {}
+
+    static float slice(float x) { return x < 0 ? -1.0F : 1.0F; }
+
+    void operator()(const std::vector<float>& audio,
+        std::vector<unsigned char>& output)
+    {
+        const size_t ntaps = filter_.ntaps();
+
+        for (size_t i = 0; i != audio.size(); ++i)
+        {
+            const unsigned char bit = gr_binary_slicer(audio[i]);
+            const unsigned char delayed = delay_line_[delay_pos_];
+            delay_line_[delay_pos_] = bit;
+            if (++delay_pos_ == delay_line_.size()) delay_pos_ = 0;
+
+            filter_history_.push_back(float(bit ^ delayed));
+            filtered_.push_back(dc_blocker_(filter_.filter(
+                &filter_history_[filter_history_.size() - ntaps])));
+        }
+
+        while (index_ + interp_.ntaps() <= filtered_.size())
+        {
+            const float sample = interp_.interpolate(&filtered_[index_], mu_);
+            const float mm_val = slice(last_sample_) * sample
+                - slice(sample) * last_sample_;
+            last_sample_ = sample;
+
+            omega_ = omega_ + .00005F * mm_val;
+            omega_ = omega_mid_
+                + gr_branchless_clip(omega_ - omega_mid_, omega_lim_);
+            mu_ = mu_ + omega_ + .01F * mm_val;
+
+            index_ += (int) std::floor(mu_);
+            mu_ = mu_ - std::floor(mu_);
+
+            output.push_back(gr_binary_slicer(sample) ? 0 : 1);
+        }
+    }
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(native_rate_matches_first_fused_block)
+{
+    // At 44100 Hz the samples per symbol and the delay are both
+    // truncated, from 36.75 to 36 and from 19.76 to 19.
+    const int rates[] = {22050, 44100, 48000};
+
+    for (size_t r = 0; r != 3; ++r)
+    {
+        const int rate = rates[r];
+        test::random_source random(rate);
+
+        test::bit_vector sent;
+        for (size_t i = 0; i != 10; ++i)
+        {
+            test::append_noise(sent, 200, random);
+            test::append_flags(sent, 10);
+            test::append_frame(sent, test::make_frame(60, random));
+        }
+        const std::vector<float> audio =
+            test::modulate(sent, rate, 0.7F, 0.4F, random);
+
+        std::vector<unsigned char> expected;
+        reference_demodulator reference(rate);
+        reference(audio, expected);
+
+        // In pieces, as the scheduler would give it.
+        detail::afsk1200_demodulator demod(rate, 1200, .000448, 0, 0);
+        std::vector<unsigned char> actual;
+        std::vector<unsigned char> output(4096);
+        for (size_t pos = 0; pos < audio.size(); )
+        {
+            const int n = int(std::min<size_t>(3000, audio.size() - pos));
+            int consumed = 0;
+            const int produced = demod(&audio[pos], n, &output[0],
+                int(output.size()), consumed);
+            actual.insert(actual.end(), output.begin(),
+                output.begin() + produced);
+            pos += consumed;
+        }
+
+        BOOST_REQUIRE(actual.size() + 2 >= expected.size());
+        actual.resize(std::min(actual.size(), expected.size()));
+        expected.resize(actual.size());
+        BOOST_CHECK_MESSAGE(actual == expected, "at " << rate << " Hz");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(fixed_point_matches_floating_point)
+{
+    const int rates[] = {22050, 24000, 44100, 48000};
+    const float noises[] = {0, 0.3F, 0.6F, 1.0F};
+    const float twists[] = {1.0F, 0.5F};
+
+    size_t bursts = 0;
+    size_t clean = 0;
+
+    for (size_t r = 0; r != 4; ++r)
+    for (size_t n = 0; n != 4; ++n)
+    for (size_t t = 0; t != 2; ++t)
+    {
+        const int rate = rates[r];
+        test::random_source random(1 + r * 100 + n * 10 + t);
+
+        detail::afsk1200_demodulator floating_demod(rate, 1200, .000448, 0,
+            afsk1200_demod::WORKING_RATE, afsk1200_demod::DELAY_LINE,
+            afsk1200_demod::PLL);
+        detail::fixed_point_demodulator fixed_demod(rate);
+
+        for (size_t b = 0; b != BURSTS; ++b)
+        {
+            std::vector<float> audio(rate / 5 + random.below(200));
+            for (size_t i = 0; i != audio.size(); ++i)
+            {
+                audio[i] = noises[n] * random.uniform();
+            }
+
+            test::bit_vector sent;
+            test::append_flags(sent, 25);
+            test::append_frame(sent, test::make_frame(40 + b * 10, random));
+            test::append_flags(sent, 100);
+            const std::vector<float> burst =
+                test::modulate(sent, rate, twists[t], noises[n], random);
+            audio.insert(audio.end(), burst.begin(), burst.end());
+
+            std::vector<int16_t> fixed_audio;
+            std::vector<float> floating_audio;
+            quantize(audio, fixed_audio, floating_audio);
+
+            std::vector<unsigned char> floating(audio.size());
+            std::vector<unsigned char> fixed(audio.size());
+            int consumed = 0;
+            floating.resize(floating_demod(&floating_audio[0],
+                int(audio.size()), &floating[0], int(floating.size()),
+                consumed));
+            fixed.resize(fixed_demod(&fixed_audio[0], int(audio.size()),
+                &fixed[0], int(fixed.size()), consumed));
+
+            // Every bit, noise and all.
+            BOOST_CHECK(fixed == floating);
+
+            // From the last few flags to the end of the frame, so that
+            // it is not only noise that is compared.
+            size_t offset = 0;
+            const size_t errors = best_errors(
+                floating, sent, 200, sent.size() - 780, offset);
+            if (noises[n] == 0) BOOST_CHECK_EQUAL(errors, 0U);
+
+            ++bursts;
+            clean += errors == 0;
+        }
+    }
+
+    BOOST_TEST_MESSAGE(clean << " of " << bursts
+        << " bursts decoded without error");
+}
+
+BOOST_AUTO_TEST_CASE(fixed_point_has_no_carrier_detect)
+{
+    afsk1200_demod::sptr demod = afsk1200_demod::make(48000,
+        afsk1200_demod::WORKING_RATE, false, afsk1200_demod::DELAY_LINE,
+        afsk1200_demod::PLL, true);
+
+    demod->set_carrier_threshold(0);
+    BOOST_CHECK_THROW(demod->set_carrier_threshold(0.1F),
+        std::invalid_argument);
+    BOOST_CHECK_EQUAL(demod->get_stats().samples_skipped, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(default_demodulator_reports_level_and_twist)
+{
+    // As the block makes it, with carrier detect off.
+    detail::afsk1200_demodulator demod(48000);
+    demod.set_reporting(true);
+
+    // Space at half the amplitude of mark.
+    test::random_source random(5);
+    test::bit_vector sent;
+    test::append_flags(sent, 25);
+    test::append_frame(sent, test::make_frame(200, random));
+    test::append_flags(sent, 25);
+    const std::vector<float> audio =
+        test::modulate(sent, 48000, 0.5F, 0, random);
+
+    // In pieces the size of a work() call.
+    std::vector<unsigned char> output(sent.size() * 2);
+    int produced = 0;
+    for (size_t i = 0; i < audio.size(); i += 4096)
+    {
+        int consumed = 0;
+        produced += demod(&audio[i], int(std::min(audio.size() - i,
+            size_t(4096))), &output[produced], int(output.size()) - produced,
+            consumed);
+    }
+
+    // The first bits come out of the filters before any audio, at
+    // sample 0, so there is nothing to measure for them.
+    size_t measured = 0;
+    float twist = 0;
+    for (size_t i = 0; i != demod.reports_.size(); ++i)
+    {
+        const detail::quality_report& report = demod.reports_[i];
+        if (report.sample == 0) continue;
+
+        BOOST_CHECK(report.tones);
+        BOOST_CHECK(report.level > 0.35F and report.level < 0.71F);
+        twist += report.twist;
+        ++measured;
+    }
+
+    // How much of each tone a window holds depends on the bits, so the
+    // twist is only near the 6 dB set on average.
+    BOOST_REQUIRE(measured > 20);
+    BOOST_CHECK_CLOSE(twist / measured, 6.0F, 25);
+}
+
+BOOST_AUTO_TEST_CASE(timing_error_is_in_symbols_for_both_clocks)
+{
+    const int clocks[] = {
+        afsk1200_demod::MUELLER_MULLER, afsk1200_demod::PLL};
+    const float noises[] = {0, 0.5F, 1.0F};
+    double errors[2][3];
+
+    for (size_t c = 0; c != 2; ++c)
+    for (size_t n = 0; n != 3; ++n)
+    {
+        detail::afsk1200_demodulator demod(48000, 1200, .000448, 0,
+            afsk1200_demod::WORKING_RATE, afsk1200_demod::DELAY_LINE,
+            clocks[c]);
+        demod.set_reporting(true);
+
+        test::random_source random(6);
+        test::bit_vector sent;
+        test::append_flags(sent, 25);
+        test::append_frame(sent, test::make_frame(200, random));
+        test::append_flags(sent, 25);
+        const std::vector<float> audio =
+            test::modulate(sent, 48000, 1.0F, noises[n], random);
+
+        std::vector<unsigned char> output(sent.size() * 2);
+        int consumed = 0;
+        demod(&audio[0], int(audio.size()), &output[0], int(output.size()),
+            consumed);
+
+        double error = 0;
+        size_t count = 0;
+        for (size_t i = 0; i != demod.reports_.size(); ++i)
+        {
+            if (demod.reports_[i].sample == 0) continue;
+            error += demod.reports_[i].timing_error;
+            ++count;
+        }
+        BOOST_REQUIRE(count > 20);
+        errors[c][n] = error / count;
+    }
+
+    // Both measure the same thing on the same scale, and more noise
+    // moves the transitions more.
+    for (size_t n = 0; n != 3; ++n)
+    {
+        BOOST_CHECK(errors[0][n] > 0 and errors[0][n] < 0.25);
+        BOOST_CHECK_CLOSE(errors[0][n], errors[1][n], 50);
+    }
+    BOOST_CHECK(errors[0][2] > errors[0][0]);
+    BOOST_CHECK(errors[1][2] > errors[1][0]);
+}
@@ -0,0 +1,164 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#include "ax25_frame_view.h"
+#include "test_signals.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <sstream>
+
+using namespace gr::mobilinkd;
+
+namespace {
+
+/**
+ * A random frame with a valid FCS: random addresses, now and then with
+ * unprintable characters or a space inside, up to ten repeaters, and a
+ * random control field and information.  Some are cut short.
+ */
+std::string make_frame(test::random_source& random)
+{
+    std::string frame;
+    const size_t addresses = 2 + random.below(11);
+    for (size_t i = 0; i != addresses; ++i)
+    {
+        for (size_t j = 0; j != 6; ++j)
+        {
+            char c = char('A' + random.below(26));
+            if (random.below(8) == 0) c = ' ';
+            if (random.below(64) == 0) c = char(random.below(128));
+            frame += char(c << 1);
+        }
+        // The extension bit marks the last address, and now and then
+        // is missing or set early.
+        const bool last = i + 1 == addresses;
+        const bool extension = random.below(32) ? last : not last;
+        frame += char(0x60 | (random.below(16) << 1) | extension);
+    }
+
+    frame += char(random());
+    frame += char(0xF0);
+    for (size_t i = random.below(100); i != 0; --i) frame += char(random());
+
+    crc_ccitt crc;
+    crc(frame.data(), frame.size());
+    const uint16_t fcs = ~crc.crc_;
+    frame += char(fcs & 0xFF);
+    frame += char(fcs >> 8);
+
+    if (random.below(8) == 0) frame.resize(random.below(frame.size()));
+
+    return frame;
+}
+
+std::string text(const callsign& call, ax25_frame::parse_policy policy)
+{
+    std::ostringstream output;
+    write_address(output, call, policy);
+    return output.str();
+}
+
+/// Check the view of @p data field by field against @p frame.
+void check(const std::string& data, const ax25_frame& frame,
+    ax25_frame::parse_policy policy)
+{
+    const ax25_frame_view view(data.data(), data.size());
+
+    BOOST_REQUIRE_EQUAL(view.destination().value(),
+        frame.destination_call().value());
+    BOOST_REQUIRE_EQUAL(view.source().value(), frame.source_call().value());
+    BOOST_REQUIRE_EQUAL(view.repeater_count(), frame.repeaters().size());
+    for (size_t i = 0; i != view.repeater_count(); ++i)
+    {
+        BOOST_REQUIRE_EQUAL(view.repeater(i).value(),
+            frame.repeater_calls()[i].value());
+        BOOST_REQUIRE_EQUAL(text(view.repeater(i), policy),
+            frame.repeaters()[i]);
+    }
+
+    if (view.valid())
+    {
+        BOOST_REQUIRE_EQUAL(text(view.destination(), policy),
+            frame.destination());
+        BOOST_REQUIRE_EQUAL(text(view.source(), policy), frame.source());
+    }
+
+    BOOST_REQUIRE_EQUAL(view.type(), frame.type());
+    BOOST_REQUIRE(view.pid() == frame.pid());
+    BOOST_REQUIRE_EQUAL(std::string(view.info(), view.info_size()),
+        frame.info());
+    BOOST_REQUIRE_EQUAL(view.fcs(), frame.fcs());
+    BOOST_REQUIRE_EQUAL(view.crc(), frame.crc());
+    BOOST_REQUIRE_EQUAL(view.crc_ok(), frame.crc_ok());
+
+    // A CRC given up front is used as it is, as by ax25_frame.
+    const ax25_frame_view given(data.data(), data.size(), 0x1234);
+    BOOST_REQUIRE_EQUAL(given.crc(), view.valid() ? 0x1234 : 0);
+
+    std::ostringstream expected;
+    std::ostringstream actual;
+    write(expected, frame);
+    write(actual, view, policy);
+    BOOST_REQUIRE_EQUAL(actual.str(), expected.str());
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(view_matches_strict_frame)
+{
+    test::random_source random(1);
+
+    size_t checked = 0;
+    size_t repeaters = 0;
+    for (size_t i = 0; i != 20000; ++i)
+    {
+        const std::string data = make_frame(random);
+        try
+        {
+            const strict_ax25_frame frame(data);
+            check(data, frame, ax25_frame::STRICT);
+            repeaters += frame.repeaters().size();
+            ++checked;
+        }
+        catch (bad_frame&)
+        {
+            BOOST_REQUIRE(not ax25_frame_view(data.data(), data.size())
+                .crc_ok());
+        }
+    }
+
+    BOOST_CHECK(checked > 15000);
+    BOOST_CHECK(repeaters > checked);
+}
+
+BOOST_AUTO_TEST_CASE(view_matches_sloppy_frame)
+{
+    test::random_source random(2);
+
+    for (size_t i = 0; i != 20000; ++i)
+    {
+        std::string data = make_frame(random);
+        if (not data.empty() and random.below(2))
+        {
+            data[random.below(data.size())] ^= char(1 << random.below(8));
+        }
+        check(data, sloppy_ax25_frame(data), ax25_frame::SLOPPY);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(view_reads_a_known_frame)
+{
+    const std::string data = test::make_frame("Hello");
+    const ax25_frame_view view(data.data(), data.size());
+
+    BOOST_CHECK(view.valid());
+    BOOST_CHECK(view.crc_ok());
+    BOOST_CHECK(view.destination() == callsign::from_string("APRS"));
+    BOOST_CHECK(view.source() == callsign::from_string("N0CALL"));
+    BOOST_CHECK_EQUAL(view.repeater_count(), 0U);
+    BOOST_CHECK_EQUAL(view.type(), ax25_frame::UNNUMBERED);
+    BOOST_CHECK(view.pid() == ax25_frame::pid_type(0xF0));
+    BOOST_CHECK_EQUAL(std::string(view.info(), view.info_size()), "Hello");
+}
@@ -0,0 +1,111 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#include "callsign.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <stdexcept>
+
+using namespace gr::mobilinkd;
+
+namespace {
+
+/// The 7 byte on-air address field for @p call and @p ssid.
+std::string make_field(const std::string& call, int ssid)
+{
+    std::string field;
+    for (size_t i = 0; i != 6; ++i)
+    {
+        const char c = i < call.size() ? call[i] : ' ';
+        field += char(c << 1);
+    }
+    field += char(0x60 | (ssid << 1));
+    return field;
+}
+
+callsign from_field(const std::string& field)
+{
+    return callsign::from_field(
+        reinterpret_cast<const uint8_t*>(field.data()));
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(from_string_round_trips)
+{
+    const char* calls[] = {
+        "N0CALL", "N0CALL-9", "W1AW-15", "K7A-1", "APRS", "WIDE2-2", "A"
+    };
+
+    for (size_t i = 0; i != sizeof(calls) / sizeof(calls[0]); ++i)
+    {
+        const callsign call = callsign::from_string(calls[i]);
+        BOOST_CHECK_EQUAL(call.str(), calls[i]);
+        BOOST_CHECK(callsign::from_string(call.str()) == call);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(from_field_matches_from_string)
+{
+    for (int ssid = 0; ssid <= 15; ++ssid)
+    {
+        const callsign call = from_field(make_field("N0CALL", ssid));
+        BOOST_CHECK_EQUAL(call.call(), "N0CALL");
+        BOOST_CHECK_EQUAL(call.ssid(), ssid);
+        BOOST_CHECK(callsign::from_string(call.str()) == call);
+    }
+
+    const callsign short_call = from_field(make_field("K7A", 1));
+    BOOST_CHECK_EQUAL(short_call.str(), "K7A-1");
+    BOOST_CHECK(short_call == callsign::from_string("K7A-1"));
+
+    // The callsign ends at the first space, whatever follows it.
+    std::string field = make_field("AB", 0);
+    field[3] = char('C' << 1);
+    BOOST_CHECK(from_field(field) == callsign::from_string("AB"));
+}
+
+BOOST_AUTO_TEST_CASE(ssid_limits)
+{
+    BOOST_CHECK_EQUAL(callsign::from_string("N0CALL").ssid(), 0);
+    BOOST_CHECK_EQUAL(callsign::from_string("N0CALL-0").ssid(), 0);
+    BOOST_CHECK_EQUAL(callsign::from_string("N0CALL-0").str(), "N0CALL");
+    BOOST_CHECK_EQUAL(callsign::from_string("N0CALL-15").ssid(), 15);
+    BOOST_CHECK_EQUAL(callsign::from_string("N0CALL-15").str(), "N0CALL-15");
+
+    BOOST_CHECK_THROW(callsign::from_string("N0CALL-16"),
+        std::invalid_argument);
+    BOOST_CHECK_THROW(callsign::from_string("N0CALL-"),
+        std::invalid_argument);
+    BOOST_CHECK_THROW(callsign::from_string("N0CALL--1"),
+        std::invalid_argument);
+    BOOST_CHECK_THROW(callsign::from_string("N0CALL-1A"),
+        std::invalid_argument);
+    BOOST_CHECK_THROW(callsign::from_string("N0CALL-100"),
+        std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(bad_callsigns_throw)
+{
+    BOOST_CHECK_THROW(callsign::from_string(""), std::invalid_argument);
+    BOOST_CHECK_THROW(callsign::from_string("-1"), std::invalid_argument);
+    BOOST_CHECK_THROW(callsign::from_string("N0CALLX"),
+        std::invalid_argument);
+    BOOST_CHECK_THROW(callsign::from_string("N0 CAL"),
+        std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(order_and_hash)
+{
+    const callsign a = callsign::from_string("N0CALL-1");
+    const callsign b = callsign::from_string("N0CALL-2");
+    const callsign c = callsign::from_string("N1CALL");
+
+    BOOST_CHECK(a < b);
+    BOOST_CHECK(b < c);
+    BOOST_CHECK(a != b);
+    BOOST_CHECK_EQUAL(hash_value(a),
+        hash_value(callsign::from_string("N0CALL-1")));
+}
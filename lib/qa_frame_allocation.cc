@@ -0,0 +1,286 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+// Checks that decoding frames into the ring does no heap allocation
+// once it reaches a steady state, and that neither does filtering them
+// with an ax25_frame_view.  Global operator new is replaced, so
+// this test must stay in an executable of its own.
+
+#include "hdlc_framer_impl.h"
+#include "ax25_frame_view.h"
+#include "frame_ring.h"
+#include "test_signals.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <new>
+#include <cstdlib>
+
+namespace {
+
+bool counting = false;
+size_t allocations = 0;
+
+} // namespace
+
+void* operator new(std::size_t size) throw(std::bad_alloc)
+{
+    if (counting) ++allocations;
+    void* result = std::malloc(size ? size : 1);
+    if (not result) throw std::bad_alloc();
+    return result;
+}
+
+void* operator new[](std::size_t size) throw(std::bad_alloc)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) throw()
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+    std::free(p);
+}
+
+using namespace gr::mobilinkd;
+using detail::hdlc_state_machine;
+
+namespace {
+
+const size_t FRAMES = 200;
+
+/// Back to back frames of random size, each led by a few flags.
+test::bit_vector make_stream(test::random_source& random)
+{
+    test::bit_vector bits;
+    for (size_t i = 0; i != FRAMES; ++i)
+    {
+        test::append_flags(bits, 3);
+        test::append_frame(bits, test::make_frame(
+            random.below(frame_ring::MAX_SIZE - 20), random));
+    }
+    test::append_flags(bits, 3);
+    return bits;
+}
+
+/**
+ * What hdlc_framer does with a frame sent to its ring, and what a
+ * consumer does that reuses one ring_frame.  A few frames are also
+ * taken and held, to keep more than one of the pool's buffers in use.
+ */
+struct decoder
+{
+    hdlc_state_machine state_;
+    frame_ring::sptr ring_;
+    ring_frame frame_;
+    detail::frame_buffer* held_[3];
+    size_t nheld_;
+    size_t frames_;
+
+    decoder()
+    : state_(false), ring_(frame_ring::make(4, frame_ring::DROP_OLDEST))
+    , frame_(), nheld_(0), frames_(0)
+    {}
+
+    ~decoder()
+    {
+        for (size_t i = 0; i != nheld_; ++i) state_.release_frame(held_[i]);
+    }
+
+    void frame_ready(uint64_t offset)
+    {
+        ++frames_;
+
+        if (frames_ % 5 == 0)
+        {
+            if (nheld_ == 3)
+            {
+                for (size_t i = 0; i != nheld_; ++i)
+                {
+                    state_.release_frame(held_[i]);
+                }
+                nheld_ = 0;
+            }
+            held_[nheld_++] = state_.take_frame();
+            return;
+        }
+
+        const detail::frame_buffer& data = state_.frame_data();
+        ring_->push(data.data(), data.size(), state_.crc_ok(), offset);
+        state_.clear_frame();
+        ring_->pop(frame_);
+    }
+
+    void push_bytes(const std::vector<uint8_t>& bytes)
+    {
+        for (size_t i = 0; i != bytes.size(); ++i)
+        {
+            if (state_.push_byte(bytes[i])) frame_ready(i);
+        }
+    }
+
+    void push_words(const std::vector<uint8_t>& bytes)
+    {
+        size_t i = 0;
+        while (i != bytes.size())
+        {
+            const size_t end = std::min(bytes.size(), i + 8);
+
+            if (end - i == 8)
+            {
+                uint64_t word = 0;
+                for (size_t j = 8; j-- != 0; )
+                {
+                    word = (word << 8) | bytes[i + j];
+                }
+                i += state_.push_word(word);
+            }
+
+            for (; i != end; ++i)
+            {
+                if (state_.push_byte(bytes[i])) frame_ready(i);
+            }
+        }
+    }
+};
+
+/// Allocations made by @p push on @p bytes, after one pass to warm up.
+template <typename Push>
+size_t steady_allocations(decoder& d, Push push,
+    const std::vector<uint8_t>& bytes)
+{
+    (d.*push)(bytes);
+
+    allocations = 0;
+    counting = true;
+    (d.*push)(bytes);
+    counting = false;
+
+    return allocations;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(allocations_are_counted)
+{
+    allocations = 0;
+    counting = true;
+    std::vector<uint8_t>* p = new std::vector<uint8_t>(100);
+    counting = false;
+    delete p;
+
+    BOOST_CHECK_EQUAL(allocations, 2U);
+}
+
+BOOST_AUTO_TEST_CASE(steady_decoding_does_not_allocate)
+{
+    test::random_source random(1);
+    const std::vector<uint8_t> bytes = test::pack(make_stream(random));
+
+    decoder by_byte;
+    BOOST_CHECK_EQUAL(
+        steady_allocations(by_byte, &decoder::push_bytes, bytes), 0U);
+    BOOST_CHECK_EQUAL(by_byte.frames_, 2 * FRAMES);
+    BOOST_CHECK(by_byte.frame_.crc_ok);
+
+    decoder by_word;
+    BOOST_CHECK_EQUAL(
+        steady_allocations(by_word, &decoder::push_words, bytes), 0U);
+    BOOST_CHECK_EQUAL(by_word.frames_, 2 * FRAMES);
+    BOOST_CHECK(by_word.frame_.crc_ok);
+}
+
+BOOST_AUTO_TEST_CASE(steady_repair_does_not_allocate)
+{
+    // Each frame has one bit received wrong, with the least confidence,
+    // so that every frame goes through soft_bit_repair.
+    test::random_source random(2);
+    test::bit_vector bits;
+    std::vector<int8_t> soft;
+    for (size_t i = 0; i != FRAMES; ++i)
+    {
+        test::append_flags(bits, 3);
+        const size_t start = bits.size();
+        test::append_frame(bits, test::make_frame(
+            10 + random.below(190), random));
+
+        for (size_t j = soft.size(); j != bits.size(); ++j)
+        {
+            soft.push_back(bits[j] ? 64 : -64);
+        }
+        // Past the addresses and short of the FCS and closing flag.
+        const size_t flip = start + 130 + random.below(bits.size() - start
+            - 130 - 40);
+        soft[flip] = bits[flip] ? -1 : 1;
+    }
+    test::append_flags(bits, 3);
+    for (size_t j = soft.size(); j != bits.size(); ++j)
+    {
+        soft.push_back(bits[j] ? 64 : -64);
+    }
+
+    detail::soft_bit_repair repair(1);
+    hdlc_state_machine state(false);
+    state.repair_ = &repair;
+
+    size_t good = 0;
+    for (int pass = 0; pass != 2; ++pass)
+    {
+        allocations = 0;
+        counting = pass == 1;
+
+        uint8_t byte = 0;
+        for (size_t i = 0; i != soft.size(); ++i)
+        {
+            repair(soft[i]);
+            byte |= (soft[i] > 0) << (i % 8);
+            if (i % 8 != 7) continue;
+
+            if (state.push_byte(byte))
+            {
+                if (state.crc_ok()) ++good;
+                state.clear_frame();
+            }
+            byte = 0;
+        }
+
+        counting = false;
+    }
+
+    BOOST_CHECK_EQUAL(allocations, 0U);
+    BOOST_CHECK(repair.repaired_ > FRAMES);
+    BOOST_CHECK(good > FRAMES);
+}
+
+BOOST_AUTO_TEST_CASE(filtering_with_a_view_does_not_allocate)
+{
+    test::random_source random(3);
+    std::vector<std::string> frames;
+    for (size_t i = 0; i != FRAMES; ++i)
+    {
+        frames.push_back(test::make_frame(random.below(200), random));
+    }
+    const callsign wanted = callsign::from_string("APRS");
+
+    allocations = 0;
+    counting = true;
+    size_t matched = 0;
+    for (size_t i = 0; i != frames.size(); ++i)
+    {
+        const ax25_frame_view frame(frames[i].data(), frames[i].size());
+        if (frame.crc_ok() and frame.destination() == wanted
+            and frame.source() != wanted and frame.repeater_count() == 0
+            and frame.info_size() == frames[i].size() - 18)
+        {
+            ++matched;
+        }
+    }
+    counting = false;
+
+    BOOST_CHECK_EQUAL(allocations, 0U);
+    BOOST_CHECK_EQUAL(matched, FRAMES);
+}
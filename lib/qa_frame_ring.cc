@@ -0,0 +1,246 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#include "frame_ring.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+
+#include <string>
+#include <stdexcept>
+
+using namespace gr::mobilinkd;
+
+namespace {
+
+/// Fill @p data with frame number @p n; its length and bytes follow
+/// from n.  Returns the length.
+size_t fill_frame(uint64_t n, char* data)
+{
+    const size_t size = 20 + n % 300;
+    for (size_t i = 0; i != size; ++i) data[i] = char(n * 7 + i);
+    return size;
+}
+
+std::string make_frame(uint64_t n)
+{
+    char data[frame_ring::MAX_SIZE];
+    return std::string(data, fill_frame(n, data));
+}
+
+/// Whether @p frame is frame number frame.offset, whole.
+bool is_whole(const ring_frame& frame)
+{
+    char data[frame_ring::MAX_SIZE];
+    const size_t size = fill_frame(frame.offset, data);
+    return frame.data.size() == size
+        and frame.data.compare(0, size, data, size) == 0;
+}
+
+/**
+ * Spin for a while, and now and then give up the CPU, so that the two
+ * threads interleave at many points even on one core.
+ */
+void pause(uint32_t& state)
+{
+    state = state * 1103515245 + 12345;
+    for (volatile uint32_t i = (state >> 16) % 500; i != 0; --i) {}
+    if ((state >> 12) % 16 == 0) boost::this_thread::yield();
+}
+
+/**
+ * Pops frames until the producer is done and the ring is empty,
+ * checking that each arrives whole and in order.
+ */
+struct consumer
+{
+    frame_ring::sptr ring_;
+    const boost::atomic<bool>& done_;
+    bool wait_;
+    unsigned long received_;
+    unsigned long damaged_;
+    unsigned long out_of_order_;
+
+    consumer(frame_ring::sptr ring, const boost::atomic<bool>& done,
+        bool wait)
+    : ring_(ring), done_(done), wait_(wait)
+    , received_(0), damaged_(0), out_of_order_(0)
+    {}
+
+    void operator()()
+    {
+        ring_frame frame;
+        uint64_t last = 0;
+        uint32_t random = 2;
+
+        for (;;)
+        {
+            const bool finished = done_.load();
+            const bool got = wait_ ? ring_->wait(frame, 0.001)
+                : ring_->pop(frame);
+
+            if (not got)
+            {
+                if (finished) break;
+                continue;
+            }
+
+            if (received_ != 0 and frame.offset <= last) ++out_of_order_;
+            if (not is_whole(frame)) ++damaged_;
+            last = frame.offset;
+            ++received_;
+
+            pause(random);
+        }
+    }
+};
+
+struct run_result
+{
+    unsigned long pushed;
+    unsigned long received;
+    unsigned long dropped;
+    unsigned long damaged;
+    unsigned long out_of_order;
+};
+
+/// Push @p count frames into @p ring from this thread while another
+/// pops them.
+run_result run(frame_ring::sptr ring, uint64_t count, bool wait)
+{
+    boost::atomic<bool> done(false);
+    consumer reader(ring, done, wait);
+    boost::thread thread(boost::ref(reader));
+
+    run_result result = {0, 0, 0, 0, 0};
+    uint32_t random = 1;
+    char data[frame_ring::MAX_SIZE];
+    for (uint64_t n = 0; n != count; ++n)
+    {
+        const size_t size = fill_frame(n, data);
+        if (ring->push(data, size, true, n)) ++result.pushed;
+        pause(random);
+    }
+
+    done.store(true);
+    thread.join();
+
+    result.received = reader.received_;
+    result.dropped = ring->dropped();
+    result.damaged = reader.damaged_;
+    result.out_of_order = reader.out_of_order_;
+    return result;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(bad_arguments_throw)
+{
+    BOOST_CHECK_THROW(frame_ring::make(0, frame_ring::DROP_OLDEST),
+        std::invalid_argument);
+    BOOST_CHECK_THROW(frame_ring::make(4, 3), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(overflow_policies)
+{
+    ring_frame frame;
+
+    // DROP_OLDEST keeps the newest frames, DROP_NEWEST the oldest.
+    frame_ring::sptr oldest = frame_ring::make(4, frame_ring::DROP_OLDEST);
+    frame_ring::sptr newest = frame_ring::make(4, frame_ring::DROP_NEWEST);
+    for (uint64_t n = 0; n != 10; ++n)
+    {
+        const std::string data = make_frame(n);
+        BOOST_CHECK(oldest->push(data.data(), data.size(), true, n));
+        BOOST_CHECK_EQUAL(
+            newest->push(data.data(), data.size(), true, n), n < 4);
+    }
+
+    BOOST_CHECK_EQUAL(oldest->size(), 4U);
+    BOOST_CHECK_EQUAL(oldest->dropped(), 6U);
+    BOOST_CHECK_EQUAL(newest->size(), 4U);
+    BOOST_CHECK_EQUAL(newest->dropped(), 6U);
+
+    for (uint64_t n = 0; n != 4; ++n)
+    {
+        BOOST_REQUIRE(oldest->pop(frame));
+        BOOST_CHECK_EQUAL(frame.offset, 6 + n);
+        BOOST_CHECK(frame.data == make_frame(6 + n));
+
+        BOOST_REQUIRE(newest->pop(frame));
+        BOOST_CHECK_EQUAL(frame.offset, n);
+        BOOST_CHECK(frame.data == make_frame(n));
+    }
+
+    BOOST_CHECK(not oldest->pop(frame));
+    BOOST_CHECK(not newest->wait(frame, 0.01));
+}
+
+BOOST_AUTO_TEST_CASE(long_frames_are_truncated)
+{
+    frame_ring::sptr ring = frame_ring::make(1, frame_ring::DROP_NEWEST);
+    const std::string data(frame_ring::MAX_SIZE + 10, 'x');
+    ring->push(data.data(), data.size(), false, 0);
+
+    ring_frame frame;
+    BOOST_REQUIRE(ring->pop(frame));
+    BOOST_CHECK_EQUAL(frame.data.size(), frame_ring::MAX_SIZE);
+    BOOST_CHECK(not frame.crc_ok);
+}
+
+BOOST_AUTO_TEST_CASE(producer_and_consumer_threads)
+{
+    // With a capacity of 1, DROP_OLDEST laps the consumer all the
+    // time: the producer takes frames back with compare and swap while
+    // the consumer claims them, and finds the slot it is about to fill
+    // still being read.  Every frame must still be read whole, or
+    // dropped, and never both.  On one core the threads only meet
+    // where pause() yields, so the races are hit far more often on a
+    // machine with several.
+    const size_t capacities[] = {1, 4, 16};
+    const int policies[] = {
+        frame_ring::DROP_OLDEST, frame_ring::DROP_NEWEST, frame_ring::BLOCK
+    };
+
+    for (size_t p = 0; p != 3; ++p)
+    {
+        for (size_t c = 0; c != 3; ++c)
+        {
+            for (int wait = 0; wait != 2; ++wait)
+            {
+                const int policy = policies[p];
+                const uint64_t count =
+                    policy == frame_ring::BLOCK ? 1000 : 20000;
+                const run_result result = run(
+                    frame_ring::make(capacities[c], policy), count, wait);
+
+                BOOST_TEST_MESSAGE("policy " << policy << " capacity "
+                    << capacities[c] << " wait " << wait << ": "
+                    << result.received << " received, "
+                    << result.dropped << " dropped");
+
+                BOOST_CHECK_EQUAL(result.damaged, 0U);
+                BOOST_CHECK_EQUAL(result.out_of_order, 0U);
+                BOOST_CHECK_EQUAL(result.received + result.dropped, count);
+
+                if (policy == frame_ring::DROP_OLDEST)
+                {
+                    // Frames dropped in push() were pushed, then taken
+                    // back; only those the reading_ guard turns away
+                    // are not.
+                    BOOST_CHECK(result.pushed >= result.received);
+                }
+                else
+                {
+                    BOOST_CHECK_EQUAL(result.pushed, result.received);
+                }
+
+                if (policy == frame_ring::BLOCK)
+                {
+                    BOOST_CHECK_EQUAL(result.dropped, 0U);
+                }
+            }
+        }
+    }
+}
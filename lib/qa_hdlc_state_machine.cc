@@ -0,0 +1,429 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#include "hdlc_framer_impl.h"
+#include "test_signals.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace gr::mobilinkd;
+using detail::hdlc_state_machine;
+
+namespace {
+
+typedef std::vector<std::string> frame_list;
+
+/**
+ * A random mix of what the framer sees: noise, runs of flags, frames
+ * of all lengths -- some missing a stuffed zero or cut short -- and
+ * runs of idle ones that abort a frame.
+ */
+test::bit_vector make_mix(uint32_t seed, size_t size)
+{
+    test::random_source random(seed);
+    test::bit_vector bits;
+
+    while (bits.size() < size)
+    {
+        const uint32_t choice = random.below(10);
+
+        if (choice < 3)
+        {
+            test::append_noise(bits, random.below(100), random);
+        }
+        else if (choice < 5)
+        {
+            test::append_flags(bits, random.below(6));
+        }
+        else if (choice < 9)
+        {
+            const size_t length = random.below(2)
+                ? random.below(40) : random.below(360);
+            int ones = 0;
+            for (size_t i = 0; i != length; ++i)
+            {
+                const uint8_t byte = random.below(4) ? random() : 0xFF;
+                for (int j = 0; j != 8; ++j)
+                {
+                    const int bit = (byte >> j) & 1;
+                    bits.push_back(bit);
+                    ones = bit ? ones + 1 : 0;
+                    if (ones == 5)
+                    {
+                        if (random.below(50)) bits.push_back(0);
+                        ones = 0;
+                    }
+                }
+            }
+            if (random.below(3) == 0)
+            {
+                test::append_noise(bits, random.below(8), random);
+            }
+        }
+        else
+        {
+            bits.insert(bits.end(), 7 + random.below(10), 1);
+        }
+    }
+
+    return bits;
+}
+
+/// Whether @p a and @p b would go on to produce the same frames.
+bool same_state(const hdlc_state_machine& a, const hdlc_state_machine& b)
+{
+    if (a.state_ != b.state_ or a.buffer_ != b.buffer_) return false;
+    if (a.timer_ != b.timer_ or a.crc_.crc_ != b.crc_.crc_) return false;
+    if (a.frame_->str() != b.frame_->str()) return false;
+
+    // bits_ is not used while searching, nor ones_ outside a frame.
+    if (a.state_ != hdlc_state_machine::SEARCH and a.bits_ != b.bits_)
+    {
+        return false;
+    }
+    if (a.state_ == hdlc_state_machine::FRAMING and a.ones_ != b.ones_)
+    {
+        return false;
+    }
+
+    const hdlc_state_machine::counts& x = a.counts_;
+    const hdlc_state_machine::counts& y = b.counts_;
+    return x.flags == y.flags and x.frames == y.frames
+        and x.good == y.good and x.bad == y.bad
+        and x.too_short == y.too_short and x.too_long == y.too_long
+        and x.stuff_errors == y.stuff_errors and x.timeouts == y.timeouts;
+}
+
+/// The eight bytes from @p bytes, first in the low byte, as push_word()
+/// takes them.
+uint64_t word_at(const std::vector<uint8_t>& bytes, size_t i)
+{
+    uint64_t word = 0;
+    for (size_t j = 8; j-- != 0; ) word = (word << 8) | bytes[i + j];
+    return word;
+}
+
+/// Push eight bits, LSB first, through operator().
+void push_bits(hdlc_state_machine& machine, uint8_t byte, frame_list& frames)
+{
+    for (int i = 0; i != 8; ++i)
+    {
+        if (machine((byte >> i) & 1)) frames.push_back(machine.frame());
+    }
+}
+
+/**
+ * Push @p bytes as hdlc_framer does packed input: push_word() where it
+ * takes them and push_byte() for the rest of each eight bytes.
+ */
+void push_words(hdlc_state_machine& machine,
+    const std::vector<uint8_t>& bytes, frame_list& frames)
+{
+    size_t i = 0;
+    while (i != bytes.size())
+    {
+        const size_t end = std::min(bytes.size(), i + 8);
+        if (end - i == 8) i += machine.push_word(word_at(bytes, i));
+
+        for (; i != end; ++i)
+        {
+            if (machine.push_byte(bytes[i])) frames.push_back(machine.frame());
+        }
+    }
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(push_byte_matches_operator)
+{
+    size_t total = 0;
+
+    for (uint32_t seed = 1; seed <= 100; ++seed)
+    {
+        const std::vector<uint8_t> bytes = test::pack(make_mix(seed, 100000));
+
+        hdlc_state_machine bitwise(true);
+        hdlc_state_machine bytewise(true);
+        frame_list by_bit;
+        frame_list by_byte;
+
+        for (size_t i = 0; i != bytes.size(); ++i)
+        {
+            push_bits(bitwise, bytes[i], by_bit);
+            if (bytewise.push_byte(bytes[i]))
+            {
+                by_byte.push_back(bytewise.frame());
+            }
+
+            if (not same_state(bitwise, bytewise))
+            {
+                BOOST_FAIL("state differs, seed " << seed << " byte " << i);
+            }
+        }
+
+        BOOST_CHECK(by_bit == by_byte);
+        total += by_bit.size();
+    }
+
+    BOOST_CHECK(total > 1000);
+}
+
+BOOST_AUTO_TEST_CASE(long_frames_decode)
+{
+    // Information that is all ones has a zero stuffed after every five
+    // bits, so these frames take as many bits as a frame can.  331
+    // bytes is the longest frame there is.
+    const size_t sizes[] = {250, 275, 300, 330, 331};
+
+    for (size_t k = 0; k != sizeof(sizes) / sizeof(sizes[0]); ++k)
+    {
+        const size_t size = sizes[k];
+        const std::string frame =
+            test::make_frame(std::string(size - 18, '\xFF'));
+        BOOST_REQUIRE_EQUAL(frame.size(), size);
+
+        test::bit_vector bits;
+        test::append_flags(bits, 4);
+        test::append_frame(bits, frame);
+        test::append_flags(bits, 2);
+        const std::vector<uint8_t> bytes = test::pack(bits);
+
+        hdlc_state_machine bitwise(false);
+        hdlc_state_machine bytewise(false);
+        frame_list by_bit;
+        frame_list by_byte;
+
+        for (size_t i = 0; i != bytes.size(); ++i)
+        {
+            push_bits(bitwise, bytes[i], by_bit);
+            if (bytewise.push_byte(bytes[i]))
+            {
+                by_byte.push_back(bytewise.frame());
+            }
+        }
+
+        BOOST_REQUIRE_EQUAL(by_bit.size(), 1U);
+        BOOST_CHECK(by_bit[0] == frame);
+        BOOST_CHECK(by_byte == by_bit);
+        BOOST_CHECK_EQUAL(bitwise.counts_.timeouts, 0U);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(frames_of_every_size_decode)
+{
+    // About one frame in 32 ends in five ones, so a zero is stuffed
+    // between its last byte and the closing flag.
+    for (size_t size = 18; size <= 331; ++size)
+    {
+        const std::string frame =
+            test::make_frame(std::string(size - 18, '\xFF'));
+
+        test::bit_vector bits;
+        test::append_flags(bits, 3);
+        test::append_frame(bits, frame);
+        test::append_flags(bits, 2);
+        const std::vector<uint8_t> bytes = test::pack(bits);
+
+        hdlc_state_machine bitwise(false);
+        hdlc_state_machine bytewise(false);
+        frame_list by_bit;
+        frame_list by_byte;
+
+        for (size_t i = 0; i != bytes.size(); ++i)
+        {
+            push_bits(bitwise, bytes[i], by_bit);
+            if (bytewise.push_byte(bytes[i]))
+            {
+                by_byte.push_back(bytewise.frame());
+            }
+        }
+
+        BOOST_REQUIRE_EQUAL(by_bit.size(), 1U);
+        BOOST_CHECK(by_bit[0] == frame);
+        BOOST_CHECK(by_byte == by_bit);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(frame_word_matches_operator)
+{
+    // Runs of 0xFF leave every count of ones_, 0 to 5, at some word
+    // boundary, and the noise in front of each frame moves its bytes
+    // across the words.
+    size_t taken[6] = {0};
+
+    for (uint32_t seed = 1; seed <= 2000; ++seed)
+    {
+        test::random_source random(seed);
+
+        std::string info;
+        for (size_t i = 20 + random.below(200); i != 0; --i)
+        {
+            info += char(random.below(3) ? random() : 0xFF);
+        }
+        const std::string frame = test::make_frame(info);
+
+        test::bit_vector bits;
+        test::append_noise(bits, random.below(64), random);
+        test::append_flags(bits, 2);
+        test::append_frame(bits, frame);
+        test::append_flags(bits, 2);
+        const std::vector<uint8_t> bytes = test::pack(bits);
+
+        hdlc_state_machine bitwise(false);
+        hdlc_state_machine wordwise(false);
+        frame_list by_bit;
+        frame_list by_word;
+
+        for (size_t i = 0; i != bytes.size(); ++i)
+        {
+            if (wordwise.state_ == hdlc_state_machine::FRAMING
+                and i + 8 <= bytes.size())
+            {
+                const int ones = wordwise.ones_;
+                if (wordwise.frame_word(word_at(bytes, i)))
+                {
+                    for (size_t j = 0; j != 8; ++j)
+                    {
+                        push_bits(bitwise, bytes[i + j], by_bit);
+                    }
+                    if (not same_state(bitwise, wordwise))
+                    {
+                        BOOST_FAIL("state differs, seed " << seed
+                            << " byte " << i << " ones " << ones);
+                    }
+                    ++taken[ones];
+                    i += 7;
+                    continue;
+                }
+
+                // A word that is refused must leave the state alone.
+                if (not same_state(bitwise, wordwise))
+                {
+                    BOOST_FAIL("refused word changed state, seed " << seed
+                        << " byte " << i);
+                }
+            }
+
+            push_bits(bitwise, bytes[i], by_bit);
+            if (wordwise.push_byte(bytes[i]))
+            {
+                by_word.push_back(wordwise.frame());
+            }
+        }
+
+        BOOST_REQUIRE_EQUAL(by_bit.size(), 1U);
+        BOOST_CHECK(by_bit[0] == frame);
+        BOOST_CHECK(by_word == by_bit);
+    }
+
+    for (int ones = 0; ones != 6; ++ones)
+    {
+        BOOST_CHECK_MESSAGE(taken[ones] > 100,
+            taken[ones] << " words taken with ones_ " << ones);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(push_word_matches_operator)
+{
+    size_t total = 0;
+    size_t words = 0;
+
+    for (uint32_t seed = 1; seed <= 100; ++seed)
+    {
+        const std::vector<uint8_t> bytes = test::pack(make_mix(seed, 100000));
+
+        hdlc_state_machine bitwise(true);
+        hdlc_state_machine wordwise(true);
+        frame_list by_bit;
+        frame_list by_word;
+
+        size_t i = 0;
+        while (i != bytes.size())
+        {
+            const size_t end = std::min(bytes.size(), i + 8);
+
+            if (end - i == 8)
+            {
+                const int taken = wordwise.push_word(word_at(bytes, i));
+                for (int j = 0; j != taken; ++j)
+                {
+                    push_bits(bitwise, bytes[i++], by_bit);
+                }
+                words += taken != 0;
+
+                if (not same_state(bitwise, wordwise))
+                {
+                    BOOST_FAIL("state differs after push_word(), seed "
+                        << seed << " byte " << i);
+                }
+            }
+
+            for (; i != end; ++i)
+            {
+                push_bits(bitwise, bytes[i], by_bit);
+                if (wordwise.push_byte(bytes[i]))
+                {
+                    by_word.push_back(wordwise.frame());
+                }
+            }
+        }
+
+        BOOST_CHECK(by_bit == by_word);
+        total += by_bit.size();
+    }
+
+    BOOST_CHECK(total > 1000);
+    BOOST_CHECK(words > 10000);
+}
+
+BOOST_AUTO_TEST_CASE(frames_after_any_preamble_decode)
+{
+    // hunt() once fell through from a flag to go_search(), so every
+    // second flag of a preamble went back to SEARCH, and a frame after
+    // an even number of flags was lost.  Idle ones, noise or nothing at
+    // all may come before the flags.
+    test::random_source random(1);
+
+    for (size_t flags = 1; flags <= 12; ++flags)
+    {
+        for (int lead = 0; lead != 3; ++lead)
+        {
+            const std::string frame = test::make_frame(40, random);
+
+            test::bit_vector bits;
+            if (lead == 1) bits.insert(bits.end(), 7 + random.below(20), 1);
+            if (lead == 2) test::append_noise(bits, random.below(64), random);
+            test::append_flags(bits, flags);
+            test::append_frame(bits, frame);
+            test::append_flags(bits, 9);
+            const std::vector<uint8_t> bytes = test::pack(bits);
+
+            hdlc_state_machine bitwise(false);
+            hdlc_state_machine bytewise(false);
+            hdlc_state_machine wordwise(false);
+            frame_list by_bit;
+            frame_list by_byte;
+            frame_list by_word;
+
+            for (size_t i = 0; i != bytes.size(); ++i)
+            {
+                push_bits(bitwise, bytes[i], by_bit);
+                if (bytewise.push_byte(bytes[i]))
+                {
+                    by_byte.push_back(bytewise.frame());
+                }
+            }
+            push_words(wordwise, bytes, by_word);
+
+            BOOST_REQUIRE_MESSAGE(by_bit.size() == 1,
+                "no frame after " << flags << " flags, lead " << lead);
+            BOOST_CHECK(by_bit[0] == frame);
+            BOOST_CHECK(by_byte == by_bit);
+            BOOST_CHECK(by_word == by_bit);
+        }
+    }
+}
@@ -0,0 +1,164 @@
+// Copyright 2012 mobilinkd <rob@pangalactic.org>
+// All rights reserved.
+
+#ifndef GR__MOBILINKD__TEST_SIGNALS_H_
+#define GR__MOBILINKD__TEST_SIGNALS_H_
+
+#include "crc_ccitt.h"
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+#include <stdint.h>
+
+namespace gr { namespace mobilinkd { namespace test {
+
+/**
+ * Bit streams and AFSK audio for the unit tests and benchmarks.  Bits
+ * are kept one to an entry, in the order they are sent.
+ */
+typedef std::vector<unsigned char> bit_vector;
+
+/// A small pseudo-random generator that gives the same numbers everywhere.
+struct random_source
+{
+    uint32_t state_;
+
+    explicit random_source(uint32_t seed) : state_(seed ? seed : 1) {}
+
+    uint32_t operator()()
+    {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 17;
+        state_ ^= state_ << 5;
+        return state_;
+    }
+
+    /// A number from 0 to @p n - 1.
+    uint32_t below(uint32_t n) { return (*this)() % n; }
+
+    /// A number from -1 to 1.
+    float uniform() { return float((*this)() >> 8) / 8388608.0F - 1.0F; }
+};
+
+/**
+ * Append the eight bits of @p byte, LSB first.  If @p ones is given, it
+ * counts the ones sent so far and a zero is stuffed after each five.
+ */
+inline void append_byte(bit_vector& bits, uint8_t byte, int* ones = 0)
+{
+    for (int i = 0; i != 8; ++i)
+    {
+        const int bit = (byte >> i) & 1;
+        bits.push_back(bit);
+
+        if (not ones) continue;
+        *ones = bit ? *ones + 1 : 0;
+        if (*ones == 5)
+        {
+            bits.push_back(0);
+            *ones = 0;
+        }
+    }
+}
+
+inline void append_flags(bit_vector& bits, size_t count)
+{
+    for (size_t i = 0; i != count; ++i) append_byte(bits, 0x7E);
+}
+
+inline void append_noise(
+    bit_vector& bits, size_t count, random_source& random)
+{
+    for (size_t i = 0; i != count; ++i) bits.push_back(random() & 1);
+}
+
+/// A UI frame from N0CALL to APRS with the given @p info, FCS included.
+inline std::string make_frame(const std::string& info)
+{
+    const char* addresses = "APRS  \0N0CALL\0";
+
+    std::string frame;
+    for (size_t i = 0; i != 14; ++i) frame += char(addresses[i] << 1);
+    frame[6] = char(0x60);
+    frame[13] = char(0x61);
+    frame += char(0x03);
+    frame += char(0xF0);
+    frame += info;
+
+    crc_ccitt crc;
+    crc(frame.data(), frame.size());
+    const uint16_t fcs = ~crc.crc_;
+    frame += char(fcs & 0xFF);
+    frame += char(fcs >> 8);
+
+    return frame;
+}
+
+/// As above, with @p info_size bytes of random information.
+inline std::string make_frame(size_t info_size, random_source& random)
+{
+    std::string info;
+    for (size_t i = 0; i != info_size; ++i) info += char(random());
+    return make_frame(info);
+}
+
+/// Append @p frame, bit stuffed, and its closing flag.
+inline void append_frame(bit_vector& bits, const std::string& frame)
+{
+    int ones = 0;
+    for (size_t i = 0; i != frame.size(); ++i)
+    {
+        append_byte(bits, frame[i], &ones);
+    }
+    append_flags(bits, 1);
+}
+
+/// Pack @p bits eight to a byte, LSB first.  Any odd bits at the end
+/// are left out.
+inline std::vector<uint8_t> pack(const bit_vector& bits)
+{
+    std::vector<uint8_t> bytes(bits.size() / 8);
+    for (size_t i = 0; i != bytes.size(); ++i)
+    {
+        for (int j = 0; j != 8; ++j) bytes[i] |= bits[i * 8 + j] << j;
+    }
+    return bytes;
+}
+
+/**
+ * Phase-continuous Bell 202 audio at @p rate for @p bits: 2200 Hz for a
+ * one and 1200 Hz for a zero.  The 2200 Hz tone is scaled by @p twist,
+ * and uniform noise of up to @p noise is added.
+ */
+inline std::vector<float> modulate(const bit_vector& bits, int rate,
+    float twist, float noise, random_source& random)
+{
+    std::vector<float> audio;
+    audio.reserve(size_t(bits.size() * double(rate) / 1200.0) + 1);
+
+    double phase = 0;
+    double time = 0;
+    for (size_t i = 0; i != bits.size(); )
+    {
+        const double frequency = bits[i] ? 2200 : 1200;
+        phase += 2 * M_PI * frequency / rate;
+        audio.push_back(float((bits[i] ? twist : 1.0) * std::sin(phase))
+            + noise * random.uniform());
+
+        time += 1200.0 / rate;
+        if (time >= 1)
+        {
+            time -= 1;
+            ++i;
+        }
+    }
+
+    return audio;
+}
+
+}}} // gr::mobilinkd::test
+
+#endif // GR__MOBILINKD__TEST_SIGNALS_H_
@@ -9,10 +9,26 @@
 
 %{
 #include "afsk1200_demod.h"
+#include "callsign.h"
+#include "frame_size.h"
+#include "log_sink.h"
+#include "frame_ring.h"
 #include "hdlc_framer.h"
+#include "afsk1200_diversity_rx.h"
+#include "multichannel_afsk_rx.h"
 %}
 
 %include "afsk1200_demod.h"
 GR_SWIG_BLOCK_MAGIC2(mobilinkd, afsk1200_demod);
+%include "callsign.h"
+%include "frame_size.h"
+%include "log_sink.h"
+%template(log_sink_sptr) boost::shared_ptr<gr::mobilinkd::log_sink>;
+%include "frame_ring.h"
+%template(frame_ring_sptr) boost::shared_ptr<gr::mobilinkd::frame_ring>;
 %include "hdlc_framer.h"
 GR_SWIG_BLOCK_MAGIC2(mobilinkd, hdlc_framer);
+%include "afsk1200_diversity_rx.h"
+GR_SWIG_BLOCK_MAGIC2(mobilinkd, afsk1200_diversity_rx);
+%include "multichannel_afsk_rx.h"
+GR_SWIG_BLOCK_MAGIC2(mobilinkd, multichannel_afsk_rx);